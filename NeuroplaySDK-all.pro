@@ -0,0 +1,19 @@
+#-------------------------------------------------
+#
+# The example application with the benchmark, the unit tests
+# and the mock server, built together
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    app \
+    benchmark \
+    tests \
+    mockserver
+
+app.file = NeuroplaySDK.pro
+benchmark.file = benchmark/benchmark.pro
+tests.file = tests/tests.pro
+mockserver.file = mockserver/mockserver.pro
@@ -24,16 +24,17 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++11
 
+# Keep the per-frame protocol traces (NP_TRACE) in release builds as well
+#DEFINES += NEUROPLAY_TRACE
+
+include(neuroplaysdk.pri)
+
 SOURCES += \
-    chart.cpp \
         main.cpp \
-        mainwindow.cpp \
-    neuroplaypro.cpp
+        mainwindow.cpp
 
 HEADERS += \
-    chart.h \
-        mainwindow.h \
-    neuroplaypro.h
+        mainwindow.h
 
 FORMS += \
         mainwindow.ui
@@ -0,0 +1,199 @@
+#include "bandpower.h"
+#include <QtConcurrent>
+#include <QtMath>
+
+BandPowerEngine::BandPowerEngine() :
+    m_channels(0), m_sampleRate(0), m_size(2), m_bins(2), m_step(1),
+    m_pos(0), m_total(0), m_estimatePos(0), m_windowPower(0)
+{
+    setBand(Delta, 1, 4);
+    setBand(Theta, 4, 8);
+    setBand(Alpha, 8, 13);
+    setBand(Beta, 13, 30);
+    setBand(Gamma, 30, 45);
+}
+
+void BandPowerEngine::reset(int channels, double sampleRate, int windowSize, int step)
+{
+    m_channels = qMax(channels, 0);
+    m_sampleRate = sampleRate;
+    m_size = 2;
+    while (m_size < windowSize)
+        m_size *= 2;
+    m_bins = m_size / 2 + 1;
+    m_step = qMax(step, 1);
+
+    m_history.fill(0, m_channels * m_size);
+    m_pos = 0;
+    m_total = 0;
+    m_estimatePos = 0;
+
+    m_window.resize(m_size);
+    m_windowPower = 0;
+    for (int i=0; i<m_size; i++)
+    {
+        m_window[i] = 0.5 - 0.5 * qCos(2 * M_PI * i / m_size);
+        m_windowPower += m_window[i] * m_window[i];
+    }
+
+    int bits = 0;
+    while ((1 << bits) < m_size)
+        bits++;
+    m_bitReverse.resize(m_size);
+    for (int i=0; i<m_size; i++)
+    {
+        int r = 0;
+        for (int b=0; b<bits; b++)
+            if (i & (1 << b))
+                r |= 1 << (bits - 1 - b);
+        m_bitReverse[i] = r;
+    }
+
+    m_twiddleRe.resize(m_size - 1);
+    m_twiddleIm.resize(m_size - 1);
+    for (int half=1; half<m_size; half*=2)
+    {
+        for (int k=0; k<half; k++)
+        {
+            m_twiddleRe[half - 1 + k] = qCos(-M_PI * k / half);
+            m_twiddleIm[half - 1 + k] = qSin(-M_PI * k / half);
+        }
+    }
+
+    m_re.fill(0, m_channels * m_size);
+    m_im.fill(0, m_channels * m_size);
+    m_spectrum.fill(0, m_channels * m_bins);
+    m_bandPower.fill(0, m_channels * BandCount);
+    m_channelIndex.resize(m_channels);
+    for (int j=0; j<m_channels; j++)
+        m_channelIndex[j] = j;
+    updateBandBins();
+}
+
+void BandPowerEngine::setBand(Band band, double lowHz, double highHz)
+{
+    m_bandLow[band] = lowHz;
+    m_bandHigh[band] = highHz;
+    updateBandBins();
+}
+
+void BandPowerEngine::updateBandBins()
+{
+    for (int b=0; b<BandCount; b++)
+    {
+        if (m_sampleRate <= 0)
+        {
+            m_bandBegin[b] = m_bandEnd[b] = 0;
+            continue;
+        }
+        double binHz = m_sampleRate / m_size;
+        m_bandBegin[b] = qBound(0, int(qCeil(m_bandLow[b] / binHz)), m_bins);
+        m_bandEnd[b] = qBound(m_bandBegin[b], int(qCeil(m_bandHigh[b] / binHz)), m_bins);
+    }
+}
+
+bool BandPowerEngine::append(const SampleRingBuffer &buffer, int count)
+{
+    if (!m_channels || buffer.channels() != m_channels)
+        return false;
+    count = qMin(count, buffer.size());
+    if (count <= 0)
+        return false;
+
+    // only the last window's worth of a long block stays in the history
+    int skip = qMax(count - m_size, 0);
+    int n = count - skip;
+    int mask = m_size - 1;
+    for (int j=0; j<m_channels; j++)
+    {
+        SampleRingBuffer::Span s = buffer.span(j);
+        int offset = s.size() - n;
+        double *h = m_history.data() + j * m_size;
+        int pos = m_pos;
+        for (int i=0; i<n; i++)
+        {
+            h[pos] = s[offset + i];
+            pos = (pos + 1) & mask;
+        }
+    }
+    m_pos = (m_pos + n) & mask;
+    m_total += count;
+
+    if (m_total < m_size || m_total - m_estimatePos < m_step)
+        return false;
+    m_estimatePos = m_total;
+
+    if (m_channels > 1 && m_channels * m_size >= ParallelMinimumWork)
+        QtConcurrent::blockingMap(m_channelIndex, [this](int &channel) {compute(channel);});
+    else
+        for (int j=0; j<m_channels; j++)
+            compute(j);
+    return true;
+}
+
+void BandPowerEngine::compute(int channel)
+{
+    const int n = m_size;
+    const double *h = m_history.constData() + channel * n;
+    const double *w = m_window.constData();
+    double *re = m_re.data() + channel * n;
+    double *im = m_im.data() + channel * n;
+
+    // unwrap the history oldest first, applying the window
+    int first = n - m_pos;
+    for (int i=0; i<first; i++)
+        re[i] = h[m_pos + i] * w[i];
+    for (int i=0; i<m_pos; i++)
+        re[first + i] = h[i] * w[first + i];
+    for (int i=0; i<n; i++)
+        im[i] = 0;
+
+    for (int i=0; i<n; i++)
+    {
+        int r = m_bitReverse[i];
+        if (i < r)
+            qSwap(re[i], re[r]);
+    }
+
+    // radix-2 butterflies, contiguous in k within each group
+    for (int half=1; half<n; half*=2)
+    {
+        const double *wr = m_twiddleRe.constData() + half - 1;
+        const double *wi = m_twiddleIm.constData() + half - 1;
+        for (int start=0; start<n; start+=2*half)
+        {
+            double *ar = re + start, *ai = im + start;
+            double *br = ar + half, *bi = ai + half;
+            for (int k=0; k<half; k++)
+            {
+                double tr = br[k] * wr[k] - bi[k] * wi[k];
+                double ti = br[k] * wi[k] + bi[k] * wr[k];
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+
+    // one-sided power spectral density
+    double *spec = m_spectrum.data() + channel * m_bins;
+    double norm = 2.0 / (m_sampleRate * m_windowPower);
+    for (int k=0; k<m_bins; k++)
+        spec[k] = (re[k] * re[k] + im[k] * im[k]) * norm;
+    spec[0] *= 0.5;
+    spec[m_bins - 1] *= 0.5;
+
+    double *bands = m_bandPower.data() + channel * BandCount;
+    double total = 0;
+    for (int b=0; b<BandCount; b++)
+    {
+        double sum = 0;
+        for (int k=m_bandBegin[b]; k<m_bandEnd[b]; k++)
+            sum += spec[k];
+        bands[b] = sum;
+        total += sum;
+    }
+    for (int b=0; b<BandCount; b++)
+        bands[b] = (total > 0)? 100 * bands[b] / total: 0;
+}
@@ -0,0 +1,72 @@
+#ifndef BANDPOWER_H
+#define BANDPOWER_H
+
+#include <QVector>
+#include "samplebuffer.h"
+
+// Local rhythm estimation from grabbed samples, so rhythms don't need a server round trip.
+// Each channel keeps a sliding window of the latest samples; every step() new samples the window
+// goes through a Hann-weighted FFT and the power is summed over the delta..gamma bands.
+// All per-channel state is kept in flat arrays, so the kernels are plain loops the compiler
+// vectorizes (see neuroplaysdk.pri), and the channels are processed in parallel when there is enough work.
+class BandPowerEngine
+{
+public:
+    enum Band {Delta, Theta, Alpha, Beta, Gamma, BandCount};
+
+    BandPowerEngine();
+
+    // windowSize is rounded up to a power of two
+    void reset(int channels, double sampleRate, int windowSize = 512, int step = 50);
+    void setBand(Band band, double lowHz, double highHz);
+
+    int channels() const {return m_channels;}
+    double sampleRate() const {return m_sampleRate;}
+    int windowSize() const {return m_size;}
+    int step() const {return m_step;}
+
+    // Feeds the newest count samples of the buffer.
+    // Returns true if a new estimate is ready (only the latest one is computed for a long block).
+    bool append(const SampleRingBuffer &buffer, int count);
+
+    // Band power in percent of the sum over all bands, for the latest estimate
+    double power(int channel, Band band) const {return m_bandPower[channel * BandCount + band];}
+    // Power spectrum of the latest window, windowSize() / 2 + 1 bins
+    const double *spectrum(int channel) const {return m_spectrum.constData() + channel * m_bins;}
+    int bins() const {return m_bins;}
+    double binFrequency(int bin) const {return bin * m_sampleRate / m_size;}
+    // Time of the last sample of the latest window, since the engine was reset
+    qint64 timestampMs() const {return m_sampleRate > 0? qint64(m_estimatePos * 1000 / m_sampleRate): 0;}
+
+    // Parallel processing is used from this many channels x window samples on
+    static const int ParallelMinimumWork = 4096;
+
+private:
+    int m_channels;
+    double m_sampleRate;
+    int m_size;
+    int m_bins;
+    int m_step;
+    double m_bandLow[BandCount], m_bandHigh[BandCount];
+    int m_bandBegin[BandCount], m_bandEnd[BandCount];  // bin ranges
+
+    QVector<double> m_history;      // channels x m_size ring, m_pos is the next write index
+    int m_pos;
+    qint64 m_total;                 // samples fed since reset
+    qint64 m_estimatePos;           // m_total at the latest estimate
+
+    QVector<double> m_window;       // Hann coefficients
+    double m_windowPower;           // sum of squared coefficients
+    QVector<int> m_bitReverse;
+    QVector<double> m_twiddleRe;    // per stage: half size twiddles at offset half - 1
+    QVector<double> m_twiddleIm;
+    QVector<double> m_re, m_im;     // channels x m_size FFT scratch
+    QVector<double> m_spectrum;     // channels x m_bins
+    QVector<double> m_bandPower;    // channels x BandCount
+    QVector<int> m_channelIndex;    // 0..channels-1, the sequence for parallel map
+
+    void updateBandBins();
+    void compute(int channel);
+};
+
+#endif // BANDPOWER_H
@@ -0,0 +1,130 @@
+#include "base64decoder.h"
+
+namespace
+{
+
+const quint8 Invalid = 0xFF;
+const quint8 Skip = 0xFE;
+const quint8 Padding = 0xFD;
+
+struct DecodeTable
+{
+    quint8 values[256];
+
+    DecodeTable()
+    {
+        for (int i=0; i<256; i++)
+            values[i] = Invalid;
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i=0; i<64; i++)
+            values[quint8(alphabet[i])] = quint8(i);
+        values[quint8('-')] = 62;   // base64url
+        values[quint8('_')] = 63;
+        values[quint8(' ')] = Skip;
+        values[quint8('\n')] = Skip;
+        values[quint8('\r')] = Skip;
+        values[quint8('\t')] = Skip;
+        values[quint8('=')] = Padding;
+    }
+};
+
+const DecodeTable table;
+
+} // namespace
+
+Base64Decoder::Base64Decoder()
+{
+    reset();
+}
+
+void Base64Decoder::reset()
+{
+    m_bits = 0;
+    m_count = 0;
+    m_escape = false;
+    m_finished = false;
+}
+
+int Base64Decoder::decode(const char *data, int size, char *out)
+{
+    const quint8 *p = reinterpret_cast<const quint8 *>(data);
+    const quint8 *end = p + size;
+    char *o = out;
+
+    while (p < end && !m_finished)
+    {
+        // fast path: whole groups of four valid characters
+        if (!m_count && !m_escape)
+        {
+            while (end - p >= 4)
+            {
+                quint32 a = table.values[p[0]], b = table.values[p[1]];
+                quint32 c = table.values[p[2]], d = table.values[p[3]];
+                if ((a | b | c | d) & 0xC0)
+                    break;
+                quint32 v = (a << 18) | (b << 12) | (c << 6) | d;
+                o[0] = char(v >> 16);
+                o[1] = char(v >> 8);
+                o[2] = char(v);
+                o += 3;
+                p += 4;
+            }
+            if (p >= end)
+                break;
+        }
+
+        quint8 ch = *p++;
+        if (m_escape)
+        {
+            // "\/" is the only escape that carries a base64 character, "\n" and alike are line breaks
+            m_escape = false;
+            if (ch != '/')
+                continue;
+        }
+        else if (ch == '\\')
+        {
+            m_escape = true;
+            continue;
+        }
+
+        quint8 v = table.values[ch];
+        if (v == Skip)
+            continue;
+        if (v == Invalid)
+            return -1;
+        if (v == Padding)
+        {
+            o += finish(o);
+            m_finished = true;
+            break;
+        }
+        m_bits = (m_bits << 6) | v;
+        if (++m_count == 4)
+        {
+            *o++ = char(m_bits >> 16);
+            *o++ = char(m_bits >> 8);
+            *o++ = char(m_bits);
+            m_bits = 0;
+            m_count = 0;
+        }
+    }
+    return int(o - out);
+}
+
+int Base64Decoder::finish(char *out)
+{
+    // the 2 or 3 sextets of the last group
+    int n = 0;
+    if (m_count == 2)
+    {
+        out[n++] = char(m_bits >> 4);
+    }
+    else if (m_count == 3)
+    {
+        out[n++] = char(m_bits >> 10);
+        out[n++] = char(m_bits >> 2);
+    }
+    m_bits = 0;
+    m_count = 0;
+    return n;
+}
@@ -0,0 +1,31 @@
+#ifndef BASE64DECODER_H
+#define BASE64DECODER_H
+
+#include <QtGlobal>
+
+// Incremental base64 decoder for text taken straight from a JSON string.
+// Input may be split at any point between calls; whitespace and JSON escapes ("\/") are handled.
+// Groups of clean input are decoded four characters at a time through a lookup table.
+class Base64Decoder
+{
+public:
+    Base64Decoder();
+    void reset();
+
+    // Decodes size characters into out, which must have room for maxDecodedSize(size) bytes.
+    // Returns the number of bytes written, or -1 if the input is not base64.
+    int decode(const char *data, int size, char *out);
+    static int maxDecodedSize(int size) {return size / 4 * 3 + 3;}
+    // Writes out the last incomplete group of unpadded input (up to 2 bytes)
+    int finish(char *out);
+
+    bool isFinished() const {return m_finished;}
+
+private:
+    quint32 m_bits;     // pending sextets
+    int m_count;        // number of them
+    bool m_escape;
+    bool m_finished;    // padding seen
+};
+
+#endif // BASE64DECODER_H
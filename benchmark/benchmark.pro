@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Benchmarks for the NeuroplaySDK data path
+#
+#-------------------------------------------------
+
+QT       += core gui widgets network websockets
+
+TARGET = NeuroplayBenchmark
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../neuroplaysdk.pri)
+
+SOURCES += \
+        main.cpp
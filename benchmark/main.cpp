@@ -0,0 +1,361 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QImage>
+#include <QQueue>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include "grabdecoder.h"
+#include "neuroplaypro.h"
+#include "chart.h"
+
+// ====================== Allocation counter ====================== //
+
+// Every heap allocation of the process goes through here with glibc, Qt containers included:
+// the malloc family is replaced and forwarded to glibc's exported __libc_* entry points.
+// The aligned functions are replaced too, aligned operator new allocates with them.
+#if defined(__GLIBC__)
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<quint64> allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void *))
+        return EINVAL;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = __libc_memalign(alignment, size);
+    if (!p)
+        return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+extern "C" void *valloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_valloc(size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static qint64 allocationCount() {return qint64(allocations.load(std::memory_order_relaxed));}
+#else
+// not counted on this platform, reported as -1
+static qint64 allocationCount() {return -1;}
+#endif
+
+// ========================= Input frames ========================= //
+
+// Synthetic grabfiltereddata frame, channels x samples of EEG-like values
+static QByteArray makeGrabFrame(int channels, int samples, int offset = 0)
+{
+    QByteArray frame = "{\"command\":\"grabfiltereddata\",\"result\":true,\"data\":[";
+    for (int j=0; j<channels; j++)
+    {
+        frame += (j? ",[": "[");
+        for (int i=offset; i<offset+samples; i++)
+        {
+            double value = 40.0 * qSin(i * 0.0628 * (j + 1)) + 3.7 * qCos(i * 1.3);
+            if (i > offset)
+                frame += ',';
+            frame += QByteArray::number(value, 'g', 15);
+        }
+        frame += ']';
+    }
+    frame += "]}";
+    return frame;
+}
+
+// currentdeviceinfo response that makes a device with the given channel count current
+static QByteArray makeDeviceFrame(int channels)
+{
+    QJsonObject mode;
+    mode["channels"] = channels;
+    mode["frequency"] = 500;
+    QJsonObject device;
+    device["name"] = QString("Benchmark %1ch").arg(channels);
+    device["model"] = "NeuroPlay-8Cap";
+    device["serialNumber"] = QString("BENCH%1").arg(channels);
+    device["maxChannels"] = channels;
+    device["preferredChannelCount"] = channels;
+    device["channelModes"] = QJsonArray{mode};
+    QJsonObject resp;
+    resp["command"] = "currentdeviceinfo";
+    resp["result"] = true;
+    resp["device"] = device;
+    return QJsonDocument(resp).toJson(QJsonDocument::Compact);
+}
+
+// ======================= Decoder benchmark ====================== //
+
+// The decode path used before GrabDecoder: JSON tree plus per-sample queue entries
+static int decodeLegacy(const QByteArray &frame, QQueue< QVector<double> > &buffer)
+{
+    QJsonObject resp = QJsonDocument::fromJson(frame).object();
+    QJsonArray arr = resp["data"].toArray();
+    int chnum = arr.size();
+    int count = arr[0].toArray().size();
+    for (int i=0; i<count; i++)
+    {
+        QVector<double> entry;
+        for (int j=0; j<chnum; j++)
+        {
+            entry << arr[j].toArray()[i].toDouble();
+        }
+        buffer.enqueue(entry);
+    }
+    return count;
+}
+
+static void benchDecode(int channels, int samples, int iterations)
+{
+    QByteArray frame = makeGrabFrame(channels, samples);
+
+    QElapsedTimer timer;
+    QQueue< QVector<double> > queue;
+    timer.start();
+    for (int k=0; k<iterations; k++)
+    {
+        decodeLegacy(frame, queue);
+        queue.clear();
+    }
+    double legacyUs = timer.nsecsElapsed() / 1000.0 / iterations;
+
+    SampleRingBuffer buffer(channels, samples);
+    timer.restart();
+    for (int k=0; k<iterations; k++)
+    {
+        GrabDecoder::decodeData(frame, buffer, samples);
+        buffer.clear();
+    }
+    double fastUs = timer.nsecsElapsed() / 1000.0 / iterations;
+
+    printf("decode %dch x %d samples (%d bytes): legacy %.1f us, GrabDecoder %.1f us, x%.1f\n",
+           channels, samples, frame.size(), legacyUs, fastUs, legacyUs / fastUs);
+}
+
+// ====================== Pipeline benchmark ====================== //
+
+// Frames enter either as socket text (NeuroplayPro::onSocketResponse, the decoder fast path)
+// or as parsed JSON (NeuroplayPro::onResponse -> NeuroplayDevice::onResponse, the QJson path)
+enum Path {SocketPath, JsonPath};
+
+typedef struct
+{
+    Path path;
+    int channels;
+    int samples;    // per frame
+    int depth;      // frames buffered between drains
+    int frames;
+    double samplesPerSecond;
+    double frameP50Us, frameP90Us, frameP99Us;  // delivery of one frame into the device buffer
+    double drainP50Us, drainP99Us;              // readFilteredDataHistory() + Chart::setData() + render
+    double allocsPerFrame;
+} Result;
+
+static double percentile(QVector<double> values, double p)
+{
+    if (values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    int index = qBound(0, int(p * (values.size() - 1) + 0.5), values.size() - 1);
+    return values[index];
+}
+
+static Result benchPipeline(NeuroplayPro *pro, Chart *chart, Path path, int channels, int samples, int depth)
+{
+    QMetaObject::invokeMethod(pro, "onSocketResponse", Qt::DirectConnection,
+                              Q_ARG(QString, QString::fromUtf8(makeDeviceFrame(channels))));
+    NeuroplayDevice *dev = pro->currentDevice();
+
+    // a few distinct frames, so the data doesn't repeat exactly
+    const int variants = 8;
+    QVector<QString> texts;
+    QVector<QJsonObject> objects;
+    for (int k=0; k<variants; k++)
+    {
+        QByteArray frame = makeGrabFrame(channels, samples, k * samples);
+        texts << QString::fromUtf8(frame);
+        objects << QJsonDocument::fromJson(frame).object();
+    }
+
+    Result r;
+    r.path = path;
+    r.channels = channels;
+    r.samples = samples;
+    r.depth = depth;
+    // about 200000 samples per channel, in whole drain cycles
+    r.frames = qMax(200000 / samples / depth, 4) * depth;
+
+    QImage image(chart->size(), QImage::Format_ARGB32_Premultiplied);
+    QVector<double> frameUs, drainUs;
+    frameUs.reserve(r.frames);
+    drainUs.reserve(r.frames / depth);
+
+    // warm up: buffers, glyph and painter caches
+    dev->readFilteredDataHistory();
+    for (int k=0; k<depth; k++)
+        QMetaObject::invokeMethod(pro, "onSocketResponse", Qt::DirectConnection, Q_ARG(QString, texts[k % variants]));
+    chart->setData(dev->readFilteredDataHistory(), 200);
+    chart->render(&image);
+
+    QElapsedTimer total, timer;
+    qint64 allocs0 = allocationCount();
+    total.start();
+    for (int k=0; k<r.frames; k++)
+    {
+        timer.start();
+        if (path == SocketPath)
+            QMetaObject::invokeMethod(pro, "onSocketResponse", Qt::DirectConnection, Q_ARG(QString, texts[k % variants]));
+        else
+            QMetaObject::invokeMethod(pro, "onResponse", Qt::DirectConnection, Q_ARG(QJsonObject, objects[k % variants]));
+        frameUs << timer.nsecsElapsed() / 1000.0;
+
+        if ((k + 1) % depth == 0)
+        {
+            timer.start();
+            chart->setData(dev->readFilteredDataHistory(), 200);
+            chart->render(&image);
+            drainUs << timer.nsecsElapsed() / 1000.0;
+        }
+    }
+    double seconds = total.nsecsElapsed() / 1e9;
+    qint64 allocs1 = allocationCount();
+
+    r.samplesPerSecond = double(r.frames) * samples / seconds;
+    r.frameP50Us = percentile(frameUs, 0.50);
+    r.frameP90Us = percentile(frameUs, 0.90);
+    r.frameP99Us = percentile(frameUs, 0.99);
+    r.drainP50Us = percentile(drainUs, 0.50);
+    r.drainP99Us = percentile(drainUs, 0.99);
+    // the result vectors themselves were reserved up front
+    r.allocsPerFrame = (allocs0 < 0)? -1: double(allocs1 - allocs0) / r.frames;
+    return r;
+}
+
+static void printResult(const Result &r)
+{
+    printf("%-6s %dch x %3d samples, depth %2d: %10.0f samples/s  frame p50 %7.1f p90 %7.1f p99 %7.1f us  "
+           "drain p50 %8.1f p99 %8.1f us  allocs/frame %.1f\n",
+           (r.path == SocketPath)? "socket": "json", r.channels, r.samples, r.depth, r.samplesPerSecond,
+           r.frameP50Us, r.frameP90Us, r.frameP99Us, r.drainP50Us, r.drainP99Us, r.allocsPerFrame);
+}
+
+static QJsonObject resultJson(const Result &r)
+{
+    QJsonObject o;
+    o["path"] = (r.path == SocketPath)? "socket": "json";
+    o["channels"] = r.channels;
+    o["samplesPerFrame"] = r.samples;
+    o["depth"] = r.depth;
+    o["frames"] = r.frames;
+    o["samplesPerSecond"] = r.samplesPerSecond;
+    o["frameP50Us"] = r.frameP50Us;
+    o["frameP90Us"] = r.frameP90Us;
+    o["frameP99Us"] = r.frameP99Us;
+    o["drainP50Us"] = r.drainP50Us;
+    o["drainP99Us"] = r.drainP99Us;
+    o["allocsPerFrame"] = r.allocsPerFrame;
+    return o;
+}
+
+int main(int argc, char *argv[])
+{
+    // the chart is rendered into an image, no display is needed
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication a(argc, argv);
+    bool json = a.arguments().contains("--json");
+
+    if (!json)
+    {
+        // 8 channels x 1 second at 500 Hz
+        benchDecode(8, 500, 200);
+    }
+
+    // no socket is opened, the frames are fed to the response slots directly
+    NeuroplayPro pro;
+    Chart chart;
+    chart.resize(800, 400);
+
+    QJsonArray results;
+    const int channelCounts[] = {1, 6, 8};
+    const int frameSizes[] = {25, 100, 500};
+    const int depths[] = {1, 8};
+    for (Path path: {SocketPath, JsonPath})
+    {
+        for (int channels: channelCounts)
+        {
+            for (int samples: frameSizes)
+            {
+                for (int depth: depths)
+                {
+                    Result r = benchPipeline(&pro, &chart, path, channels, samples, depth);
+                    if (json)
+                        results.append(resultJson(r));
+                    else
+                        printResult(r);
+                }
+            }
+        }
+    }
+
+    if (json)
+    {
+        QJsonObject report;
+        report["benchmark"] = "pipeline";
+        report["qtVersion"] = qVersion();
+        report["results"] = results;
+        printf("%s\n", QJsonDocument(report).toJson(QJsonDocument::Indented).constData());
+    }
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "chart.h"
+#include "metrics.h"
 
 Chart::Chart(QWidget *parent) : QWidget(parent)
 {
@@ -8,43 +9,238 @@ Chart::Chart(QWidget *parent) : QWidget(parent)
 
 void Chart::setData(const NeuroplayDevice::ChannelsData &data, double limit)
 {
+    m_window = 0;
     m_limit = limit;
+    m_data = data;
+    m_seriesSize = QSize();
+    update();
+}
+
+void Chart::clear()
+{
+    m_window = 0;
+    m_data.clear();
     m_series.clear();
-    for (QVector<double> chdata: data)
+    m_seriesSize = QSize();
+    update();
+}
+
+void Chart::updateSeries()
+{
+    int w = width();
+    int channels = m_data.size();
+    double scale = channels? double(height()) / channels / m_limit: 0;
+
+    m_series.resize(channels);
+    for (int j=0; j<channels; j++)
     {
-        QVector<QPointF> line;
-        for (int i=0; i<chdata.size(); i++)
-            line << QPointF(i, chdata[i] * double(height()) / data.size() / m_limit);
-        m_series << line;
+        const QVector<double> &chdata = m_data[j];
+        QPolygonF &line = m_series[j];
+        int count = chdata.size();
+        line.clear();
+        if (count <= w)
+        {
+            // fewer samples than pixels, every sample is a vertex
+            line.reserve(count);
+            for (int i=0; i<count; i++)
+                line << QPointF(count > 1? double(i) * w / count: 0, chdata[i] * scale);
+            continue;
+        }
+
+        // min and max of each pixel column, in the order they occur so the trace stays continuous
+        line.reserve(2 * w);
+        const double *v = chdata.constData();
+        int begin = 0;
+        for (int x=0; x<w; x++)
+        {
+            int end = int(qint64(x + 1) * count / w);
+            int iMin = begin, iMax = begin;
+            for (int i=begin+1; i<end; i++)
+            {
+                if (v[i] < v[iMin])
+                    iMin = i;
+                else if (v[i] > v[iMax])
+                    iMax = i;
+            }
+            double px = x + 0.5;
+            if (iMin == iMax)
+            {
+                line << QPointF(px, v[iMin] * scale);
+            }
+            else if (iMin < iMax)
+            {
+                line << QPointF(px, v[iMin] * scale);
+                line << QPointF(px, v[iMax] * scale);
+            }
+            else
+            {
+                line << QPointF(px, v[iMax] * scale);
+                line << QPointF(px, v[iMin] * scale);
+            }
+            begin = end;
+        }
     }
-    update();
+    m_seriesSize = size();
 }
 
-void Chart::clear()
+void Chart::setScrolling(int windowSamples)
 {
+    m_window = qMax(windowSamples, 0);
+    m_data.clear();
     m_series.clear();
+    m_seriesSize = QSize();
+    m_strip.reset(0, 1);
+    m_stripTotal = 0;
+    m_stripColumns = 0;
+    m_stripPixmap = QPixmap();
+    m_stripLast.clear();
     update();
 }
 
+void Chart::appendData(const NeuroplayDevice::ChannelsData &data, double limit)
+{
+    if (!isScrolling() || data.isEmpty() || data[0].isEmpty())
+        return;
+    if (data.size() != m_strip.channels())
+    {
+        // twice the window, so the samples of all columns completed between two repaints are still there
+        m_strip.reset(data.size(), 2 * m_window);
+        m_stripTotal = 0;
+        m_stripColumns = 0;
+        m_stripPixmap = QPixmap();
+    }
+    if (limit != m_limit)
+    {
+        m_limit = limit;
+        m_stripPixmap = QPixmap();
+    }
+    m_strip.append(data);
+    m_stripTotal += data[0].size();
+    update();
+}
+
+// Column c covers the samples [c * m_window / width, (c + 1) * m_window / width)
+qint64 Chart::completedColumns() const
+{
+    int w = width();
+    if (w <= 0 || !m_window)
+        return 0;
+    return ((m_stripTotal + 1) * w - 1) / m_window;
+}
+
+void Chart::redrawStrip()
+{
+    int w = width();
+    qint64 last = completedColumns();
+    qint64 first = qMax(last - w, qint64(0));
+    // skip the columns whose samples have already left the buffer
+    qint64 oldest = m_stripTotal - m_strip.size();
+    while (first < last && first * m_window / w < oldest)
+        first++;
+
+    m_stripPixmap = QPixmap(size());
+    m_stripPixmap.fill(Qt::white);
+    m_stripLast.clear();
+    QPainter p(&m_stripPixmap);
+    drawStripColumns(p, first, last);
+    m_stripColumns = last;
+}
+
+// Draws the columns [first, last) with the last one at the right edge
+void Chart::drawStripColumns(QPainter &p, qint64 first, qint64 last)
+{
+    int w = width();
+    int channels = m_strip.channels();
+    if (!channels || first >= last)
+        return;
+    int h1 = height() / channels;
+    double scale = double(height()) / channels / m_limit;
+    qint64 oldest = m_stripTotal - m_strip.size();
+
+    int known = m_stripLast.size();
+    bool drawn = false;
+    m_stripLast.resize(channels);
+    for (int j=0; j<channels; j++)
+    {
+        SampleRingBuffer::Span s = m_strip.span(j);
+        double y0 = lrintf((j + 0.5f) * h1);
+        QPointF &prev = m_stripLast[j];
+        bool hasPrev = (j < known);
+        for (qint64 c=first; c<last; c++)
+        {
+            int begin = int(c * m_window / w - oldest);
+            int end = int((c + 1) * m_window / w - oldest);
+            if (begin >= end)
+                continue;   // more pixels than samples
+            double vMin = s[begin], vMax = vMin;
+            for (int i=begin+1; i<end; i++)
+            {
+                double v = s[i];
+                if (v < vMin)
+                    vMin = v;
+                else if (v > vMax)
+                    vMax = v;
+            }
+            double px = w - last + c + 0.5;
+            QPointF entry(px, y0 + s[begin] * scale);
+            if (hasPrev)
+                p.drawLine(prev, entry);
+            if (vMin != vMax)
+                p.drawLine(QPointF(px, y0 + vMin * scale), QPointF(px, y0 + vMax * scale));
+            prev = QPointF(px, y0 + s[end - 1] * scale);
+            hasPrev = true;
+            drawn = true;
+        }
+    }
+    if (!drawn)
+        m_stripLast.resize(known);
+}
+
 void Chart::paintEvent(QPaintEvent *)
 {
+    static MetricsHistogram *painting = NeuroplayMetrics::histogram("neuroplay_chart_paint_us", "Painting of a chart");
+    MetricsTimer timer(painting);
     QPainter p(this);
+    if (isScrolling())
+    {
+        int w = width();
+        if (w <= 0)
+            return;
+        qint64 last = completedColumns();
+        qint64 dx = last - m_stripColumns;
+        qint64 oldest = m_stripTotal - m_strip.size();
+        if (m_stripPixmap.size() != size() || dx >= w || m_stripColumns * m_window / w < oldest)
+        {
+            redrawStrip();
+        }
+        else if (dx > 0)
+        {
+            // shift the picture and draw only the new columns
+            m_stripPixmap.scroll(-int(dx), 0, m_stripPixmap.rect());
+            for (QPointF &point: m_stripLast)
+                point.rx() -= dx;
+            QPainter sp(&m_stripPixmap);
+            sp.fillRect(w - int(dx), 0, int(dx), height(), Qt::white);
+            drawStripColumns(sp, m_stripColumns, last);
+            m_stripColumns = last;
+        }
+        p.drawPixmap(0, 0, m_stripPixmap);
+        return;
+    }
+
     int h = height();
-    int w = width();
     p.fillRect(rect(), Qt::white);
+    if (m_seriesSize != size())
+        updateSeries();
     if (!m_series.isEmpty())
     {
-        int channels = m_series.size();//? 1: 0;
+        int channels = m_series.size();
         int h1 = channels? h / channels: 0;
         for (int i=0; i<channels; i++)
         {
-            int count = m_series[i].size();
             int y0 = lrintf((i + 0.5f) * h1);
-
             p.resetTransform();
             p.translate(0, y0);
-            p.scale(double(w) / count, 1);//double(h1) / m_limit);
-            //            p.scale(double(w) / count, h1 / m_limit);
             p.drawPolyline(m_series[i]);
         }
     }
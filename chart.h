@@ -5,6 +5,10 @@
 #include "neuroplaypro.h"
 
 
+// Multichannel plot. Channels wider than the widget are drawn as per-pixel-column min/max envelopes,
+// which are cached until the data or the widget size changes, so repaints cost O(width), not O(samples).
+// In scrolling mode the data is appended instead: the picture is shifted left and only the newly
+// completed pixel columns are drawn, so the cost of a block is proportional to its size.
 class Chart: public QWidget
 {
     Q_OBJECT
@@ -12,11 +16,34 @@ public:
     Chart(QWidget *parent = nullptr);
     void setData(const NeuroplayDevice::ChannelsData &data, double limit);
     void clear();
+
+    // Scrolling (strip chart) mode showing the last windowSamples samples across the width, 0 turns it off
+    void setScrolling(int windowSamples);
+    bool isScrolling() const {return m_window > 0;}
+    void appendData(const NeuroplayDevice::ChannelsData &data, double limit);
+
 protected:
     void paintEvent(QPaintEvent *) override;
 private:
-    QVector< QVector<QPointF> > m_series;
+    NeuroplayDevice::ChannelsData m_data;
     double m_limit = 1000000;
+
+    QVector<QPolygonF> m_series;    // per channel, in pixels relative to the channel's baseline
+    QSize m_seriesSize;             // widget size the series were built for, invalid if stale
+
+    void updateSeries();
+
+    // scrolling mode
+    int m_window = 0;
+    SampleRingBuffer m_strip;       // latest samples, enough to redraw the whole width
+    qint64 m_stripTotal = 0;        // samples appended since the mode was entered
+    qint64 m_stripColumns = 0;      // pixel columns completed and drawn into the pixmap
+    QPixmap m_stripPixmap;
+    QVector<QPointF> m_stripLast;   // last drawn point of each channel
+
+    qint64 completedColumns() const;
+    void redrawStrip();
+    void drawStripColumns(QPainter &p, qint64 first, qint64 last);
 };
 
 
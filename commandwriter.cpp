@@ -0,0 +1,69 @@
+#include "commandwriter.h"
+#include <QLocale>
+
+CommandWriter::CommandWriter(const char *command)
+{
+    m_text.reserve(64);
+    m_text += "{\"command\":\"";
+    m_text += command;
+    m_text += '"';
+}
+
+CommandWriter &CommandWriter::add(const char *key, const QString &value)
+{
+    appendKey(key);
+    appendString(value);
+    return *this;
+}
+
+CommandWriter &CommandWriter::add(const char *key, int value)
+{
+    appendKey(key);
+    m_text += QByteArray::number(value);
+    return *this;
+}
+
+CommandWriter &CommandWriter::add(const char *key, double value)
+{
+    appendKey(key);
+    m_text += QByteArray::number(value, 'g', QLocale::FloatingPointShortest);
+    return *this;
+}
+
+QByteArray CommandWriter::toUtf8() const
+{
+    return m_text + '}';
+}
+
+void CommandWriter::appendKey(const char *key)
+{
+    m_text += ",\"";
+    m_text += key;
+    m_text += "\":";
+}
+
+void CommandWriter::appendString(const QString &value)
+{
+    static const char hex[] = "0123456789abcdef";
+    m_text += '"';
+    QByteArray utf8 = value.toUtf8();
+    for (char c: utf8)
+    {
+        if (c == '"' || c == '\\')
+        {
+            m_text += '\\';
+            m_text += c;
+        }
+        else if (uchar(c) < 0x20)
+        {
+            m_text += "\\u00";
+            m_text += hex[(uchar(c) >> 4) & 0xf];
+            m_text += hex[uchar(c) & 0xf];
+        }
+        else
+        {
+            m_text += c;
+        }
+    }
+    m_text += '"';
+}
@@ -0,0 +1,29 @@
+#ifndef COMMANDWRITER_H
+#define COMMANDWRITER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Compact UTF-8 writer for parameterized NeuroPlayPro commands:
+//   CommandWriter("startdevice").add("sn", sn).add("channels", 8).toUtf8()
+// gives {"command":"startdevice","sn":"...","channels":8} without building a QJsonDocument.
+// Commands without parameters are sent as plain text and need no writer.
+class CommandWriter
+{
+public:
+    explicit CommandWriter(const char *command);
+
+    CommandWriter &add(const char *key, const QString &value);
+    CommandWriter &add(const char *key, int value);
+    CommandWriter &add(const char *key, double value);
+
+    QByteArray toUtf8() const;
+
+private:
+    QByteArray m_text;
+
+    void appendKey(const char *key);
+    void appendString(const QString &value);
+};
+
+#endif // COMMANDWRITER_H
@@ -0,0 +1,216 @@
+#include "edfrecorder.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace
+{
+
+// EDF header fields are space-padded ASCII of a fixed width
+QByteArray field(const QString &text, int width)
+{
+    QByteArray bytes = text.toLatin1().left(width);
+    return bytes + QByteArray(width - bytes.size(), ' ');
+}
+
+// The text of a number field with as many decimals as fit; readers scale with this text,
+// so the recorder scales with its value too
+QByteArray numberText(double value, int width)
+{
+    for (int decimals = 6; decimals > 0; decimals--)
+    {
+        QByteArray bytes = QByteArray::number(value, 'f', decimals);
+        if (bytes.size() <= width)
+            return bytes;
+    }
+    return QByteArray::number(qBound(-9999999.0, value, 99999999.0), 'f', 0);
+}
+
+// EDF+ dates use English month names whatever the locale is
+QString startDate(const QDate &date)
+{
+    static const char *const months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+    return QString("%1-%2-%3").arg(date.day(), 2, 10, QChar('0')).arg(months[date.month() - 1]).arg(date.year());
+}
+
+const int HeaderBytes = 256;
+const int SignalHeaderBytes = 256;
+const int RecordsFieldOffset = 236;
+
+} // namespace
+
+EdfRecorder::EdfRecorder(QObject *parent) : QObject(parent),
+    m_samples(1024),
+    m_droppedBlocks(0),
+    m_channels(0),
+    m_sampleRate(0),
+    m_physicalMin(-3276.8), m_physicalMax(3276.7),
+    m_records(0),
+    m_recordFill(0)
+{
+}
+
+EdfRecorder::~EdfRecorder()
+{
+    close();
+}
+
+void EdfRecorder::open(const QString &fileName, int channels, int sampleRate, double physicalMin, double physicalMax)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        emit error(QString("can't write %1: %2").arg(fileName, m_file.errorString()));
+        return;
+    }
+    m_channels = channels;
+    m_sampleRate = qMax(sampleRate, 1);
+    m_physicalMin = numberText(physicalMin, 8).toDouble();
+    m_physicalMax = numberText(physicalMax, 8).toDouble();
+    if (m_physicalMax <= m_physicalMin)
+    {
+        emit error(QString("empty physical range %1..%2").arg(physicalMin).arg(physicalMax));
+        m_file.close();
+        return;
+    }
+    m_records = 0;
+    m_record.fill(0, m_channels * m_sampleRate);
+    m_recordFill = 0;
+    m_startTime = QDateTime::currentDateTime();
+    writeHeader();
+}
+
+bool EdfRecorder::write(const char *data, qint64 size)
+{
+    if (m_file.write(data, size) == size)
+        return true;
+    writeFailed();
+    return false;
+}
+
+void EdfRecorder::writeFailed()
+{
+    // e.g. the disk is full: the recording ends here, without a finished()
+    emit error(QString("can't write %1: %2").arg(m_file.fileName(), m_file.errorString()));
+    m_file.close();
+}
+
+void EdfRecorder::writePending()
+{
+    SampleBlock block;
+    while (m_samples.pop(block))
+    {
+        // e.g. after a channel mode change, the file keeps the layout of its header
+        if (!m_file.isOpen() || block.data.size() != m_channels)
+        {
+            countDroppedBlock();
+            continue;
+        }
+
+        int count = block.data[0].size();
+        double scale = 65535.0 / (m_physicalMax - m_physicalMin);
+        int done = 0;
+        while (done < count)
+        {
+            int n = qMin(count - done, m_sampleRate - m_recordFill);
+            for (int j=0; j<m_channels; j++)
+            {
+                const double *src = block.data[j].constData() + done;
+                qint16 *dst = m_record.data() + j * m_sampleRate + m_recordFill;
+                for (int i=0; i<n; i++)
+                {
+                    double v = (qBound(m_physicalMin, src[i], m_physicalMax) - m_physicalMin) * scale - 32768;
+                    dst[i] = qint16(qRound(v));
+                }
+            }
+            m_recordFill += n;
+            done += n;
+            if (m_recordFill == m_sampleRate && !writeRecord())
+                break;
+        }
+    }
+}
+
+void EdfRecorder::close()
+{
+    if (!m_file.isOpen())
+        return;
+    writePending();
+    if (m_recordFill > 0 && m_file.isOpen())
+    {
+        // EDF has whole records only, the last one is padded with zeros
+        for (int j=0; j<m_channels; j++)
+            std::fill(m_record.begin() + j * m_sampleRate + m_recordFill, m_record.begin() + (j + 1) * m_sampleRate, 0);
+        writeRecord();
+    }
+    if (!m_file.isOpen())
+        return;
+    // buffered data may only fail to go out here
+    if (!m_file.flush() || !m_file.seek(RecordsFieldOffset))
+    {
+        writeFailed();
+        return;
+    }
+    QByteArray records = field(QString::number(m_records), 8);
+    if (!write(records.constData(), records.size()))
+        return;
+    if (!m_file.flush())
+    {
+        writeFailed();
+        return;
+    }
+    QString fileName = m_file.fileName();
+    m_file.close();
+    emit finished(fileName, m_records);
+}
+
+bool EdfRecorder::writeHeader()
+{
+    QByteArray header;
+    header.reserve(HeaderBytes + SignalHeaderBytes * m_channels);
+    header += field("0", 8);
+    header += field("X X X X", 80);
+    header += field("Startdate " + startDate(m_startTime.date()) + " X X NeuroplaySDK", 80);
+    header += field(m_startTime.toString("dd.MM.yy"), 8);
+    header += field(m_startTime.toString("hh.mm.ss"), 8);
+    header += field(QString::number(HeaderBytes + SignalHeaderBytes * m_channels), 8);
+    header += field("", 44);
+    header += field("-1", 8);      // number of records, unknown until close()
+    header += field("1", 8);       // record duration, seconds
+    header += field(QString::number(m_channels), 4);
+
+    for (int j=0; j<m_channels; j++)
+        header += field(QString("EEG %1").arg(j + 1), 16);
+    for (int j=0; j<m_channels; j++)
+        header += field("AgAgCl electrode", 80);
+    for (int j=0; j<m_channels; j++)
+        header += field("uV", 8);
+    for (int j=0; j<m_channels; j++)
+        header += field(QString::fromLatin1(numberText(m_physicalMin, 8)), 8);
+    for (int j=0; j<m_channels; j++)
+        header += field(QString::fromLatin1(numberText(m_physicalMax, 8)), 8);
+    for (int j=0; j<m_channels; j++)
+        header += field("-32768", 8);
+    for (int j=0; j<m_channels; j++)
+        header += field("32767", 8);
+    for (int j=0; j<m_channels; j++)
+        header += field("", 80);
+    for (int j=0; j<m_channels; j++)
+        header += field(QString::number(m_sampleRate), 8);
+    for (int j=0; j<m_channels; j++)
+        header += field("", 32);
+
+    return write(header.constData(), header.size());
+}
+
+bool EdfRecorder::writeRecord()
+{
+    // EDF samples are little-endian 16-bit integers
+    for (qint16 &value: m_record)
+        value = qToLittleEndian(value);
+    m_recordFill = 0;
+    if (!write(reinterpret_cast<const char *>(m_record.constData()), m_record.size() * qint64(sizeof(qint16))))
+        return false;
+    m_records++;
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef EDFRECORDER_H
+#define EDFRECORDER_H
+
+#include <QObject>
+#include <QFile>
+#include <QDateTime>
+#include <QAtomicInteger>
+#include "socketworker.h"
+
+// Writes sample blocks to an EDF file as they arrive, one 1-second data record at a time.
+// Meant to live in its own thread: the producer pushes blocks into samples() and invokes
+// writePending(). Memory use doesn't depend on the recording length; the number of records
+// in the header is filled in by close(). A failed write emits error() and ends the recording,
+// finished() is then not emitted.
+class EdfRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EdfRecorder(QObject *parent = nullptr);
+    virtual ~EdfRecorder();
+
+    // Producer side, must be written from a single thread
+    SpscQueue<SampleBlock> &samples() {return m_samples;}
+    // Blocks not written: the queue was full, their channel count differs from the file's or the file is not open
+    quint64 droppedBlocks() const {return m_droppedBlocks.loadAcquire();}
+    void countDroppedBlock() {m_droppedBlocks.fetchAndAddRelaxed(1);}
+
+public slots:
+    // Physical range (in uV) is mapped to the 16-bit EDF values, samples outside it are clipped
+    void open(const QString &fileName, int channels, int sampleRate, double physicalMin, double physicalMax);
+    void writePending();
+    void close();
+
+signals:
+    void finished(QString fileName, int records);
+    void error(QString text);
+
+private:
+    SpscQueue<SampleBlock> m_samples;
+    QAtomicInteger<quint64> m_droppedBlocks;
+
+    QFile m_file;
+    QDateTime m_startTime;
+    int m_channels;
+    int m_sampleRate;
+    double m_physicalMin, m_physicalMax;
+    int m_records;
+    QVector<qint16> m_record;   // channel-major, the data record being filled
+    int m_recordFill;
+
+    bool write(const char *data, qint64 size);
+    void writeFailed();
+    bool writeHeader();
+    bool writeRecord();
+};
+
+#endif // EDFRECORDER_H
@@ -0,0 +1,175 @@
+#include "filterbank.h"
+#include <QtMath>
+
+namespace
+{
+
+// Coefficients from the Audio EQ Cookbook, normalized by a0
+void lowPass(double f0, double fs, double q, double &b0, double &b1, double &b2, double &a1, double &a2)
+{
+    double w0 = 2 * M_PI * f0 / fs;
+    double alpha = qSin(w0) / (2 * q);
+    double c = qCos(w0);
+    double a0 = 1 + alpha;
+    b0 = (1 - c) / 2 / a0;
+    b1 = (1 - c) / a0;
+    b2 = b0;
+    a1 = -2 * c / a0;
+    a2 = (1 - alpha) / a0;
+}
+
+void highPass(double f0, double fs, double q, double &b0, double &b1, double &b2, double &a1, double &a2)
+{
+    double w0 = 2 * M_PI * f0 / fs;
+    double alpha = qSin(w0) / (2 * q);
+    double c = qCos(w0);
+    double a0 = 1 + alpha;
+    b0 = (1 + c) / 2 / a0;
+    b1 = -(1 + c) / a0;
+    b2 = b0;
+    a1 = -2 * c / a0;
+    a2 = (1 - alpha) / a0;
+}
+
+void notch(double f0, double fs, double q, double &b0, double &b1, double &b2, double &a1, double &a2)
+{
+    double w0 = 2 * M_PI * f0 / fs;
+    double alpha = qSin(w0) / (2 * q);
+    double c = qCos(w0);
+    double a0 = 1 + alpha;
+    b0 = 1 / a0;
+    b1 = -2 * c / a0;
+    b2 = b0;
+    a1 = -2 * c / a0;
+    a2 = (1 - alpha) / a0;
+}
+
+} // namespace
+
+BiquadFilterBank::BiquadFilterBank() :
+    m_LPF(0), m_HPF(0), m_BSF(0),
+    m_channels(0),
+    m_sampleRate(0),
+    m_primed(false)
+{
+}
+
+void BiquadFilterBank::setFilters(double LPF, double HPF, double BSF)
+{
+    m_LPF = LPF;
+    m_HPF = HPF;
+    m_BSF = BSF;
+    updateStages();
+}
+
+void BiquadFilterBank::reset(int channels, double sampleRate)
+{
+    m_channels = qMax(channels, 0);
+    m_sampleRate = sampleRate;
+    updateStages();
+}
+
+void BiquadFilterBank::updateStages()
+{
+    const double butterworthQ = M_SQRT1_2;
+    double nyquist = m_sampleRate / 2;
+
+    m_stages.clear();
+    Stage s;
+    if (m_HPF > 0 && m_HPF < nyquist)
+    {
+        highPass(m_HPF, m_sampleRate, butterworthQ, s.b0, s.b1, s.b2, s.a1, s.a2);
+        m_stages << s;
+    }
+    if (m_LPF > 0 && m_LPF < nyquist)
+    {
+        lowPass(m_LPF, m_sampleRate, butterworthQ, s.b0, s.b1, s.b2, s.a1, s.a2);
+        m_stages << s;
+    }
+    if (m_BSF > 0 && m_BSF < nyquist)
+    {
+        notch(m_BSF, m_sampleRate, m_BSF / NotchWidthHz, s.b0, s.b1, s.b2, s.a1, s.a2);
+        m_stages << s;
+    }
+
+    m_z1.fill(0, m_stages.size() * m_channels);
+    m_z2.fill(0, m_stages.size() * m_channels);
+    m_primed = false;
+}
+
+void BiquadFilterBank::process(const SampleRingBuffer &src, int count, SampleRingBuffer &dst, int capacity)
+{
+    count = qMin(count, src.size());
+    if (count <= 0 || !src.channels())
+        return;
+    if (src.channels() != m_channels)
+        reset(src.channels(), m_sampleRate);
+    if (dst.channels() != m_channels)
+        dst.reset(m_channels, capacity);
+
+    // transpose the block to samples x channels
+    const int chnum = m_channels;
+    m_block.resize(count * chnum);
+    double *block = m_block.data();
+    for (int j=0; j<chnum; j++)
+    {
+        SampleRingBuffer::Span s = src.span(j);
+        int offset = s.size() - count;
+        for (int i=0; i<count; i++)
+            block[i * chnum + j] = s[offset + i];
+    }
+
+    if (!m_primed)
+    {
+        // start from the steady state for the first sample, so a DC offset causes no transient
+        for (int k=0; k<m_stages.size(); k++)
+        {
+            const Stage &st = m_stages[k];
+            double gain = (st.b0 + st.b1 + st.b2) / (1 + st.a1 + st.a2);
+            double *z1 = m_z1.data() + k * chnum;
+            double *z2 = m_z2.data() + k * chnum;
+            for (int j=0; j<chnum; j++)
+            {
+                double x = block[j];
+                double y = gain * x;
+                z1[j] = y - st.b0 * x;
+                z2[j] = st.b2 * x - st.a2 * y;
+                block[j] = y;   // the input of the next stage
+            }
+        }
+        // restore the first sample, it is filtered with the rest below
+        for (int j=0; j<chnum; j++)
+        {
+            SampleRingBuffer::Span s = src.span(j);
+            block[j] = s[s.size() - count];
+        }
+        m_primed = true;
+    }
+
+    for (int k=0; k<m_stages.size(); k++)
+    {
+        const Stage st = m_stages[k];
+        double *z1 = m_z1.data() + k * chnum;
+        double *z2 = m_z2.data() + k * chnum;
+        for (int i=0; i<count; i++)
+        {
+            double *x = block + i * chnum;
+            for (int j=0; j<chnum; j++)
+            {
+                double in = x[j];
+                double out = st.b0 * in + z1[j];
+                z1[j] = st.b1 * in - st.a1 * out + z2[j];
+                z2[j] = st.b2 * in - st.a2 * out;
+                x[j] = out;
+            }
+        }
+    }
+
+    for (int j=0; j<chnum; j++)
+    {
+        SampleRingBuffer::Writer w = dst.writer(j);
+        for (int i=0; i<count; i++)
+            w.put(block[i * chnum + j]);
+    }
+    dst.commit(count);
+}
@@ -0,0 +1,52 @@
+#ifndef FILTERBANK_H
+#define FILTERBANK_H
+
+#include <QVector>
+#include "samplebuffer.h"
+
+// Client-side counterpart of NeuroPlayPro's LPF/HPF/BSF filters: a cascade of biquads
+// (2nd order Butterworth low-pass and high-pass, a notch for the band stop) over raw samples.
+// The state is kept per stage as arrays over channels, and a block is filtered sample by sample
+// across all channels at once, so the inner loop is a straight vectorizable pass.
+class BiquadFilterBank
+{
+public:
+    BiquadFilterBank();
+
+    // Cutoff frequencies in Hz, 0 disables the filter
+    void setFilters(double LPF, double HPF, double BSF);
+    double LPF() const {return m_LPF;}
+    double HPF() const {return m_HPF;}
+    double BSF() const {return m_BSF;}
+
+    // Clears the filter state, keeps the settings
+    void reset(int channels, double sampleRate);
+    int channels() const {return m_channels;}
+    double sampleRate() const {return m_sampleRate;}
+
+    // Filters the newest count samples of src and appends the result to dst.
+    // dst is reset to src's channel count with the given capacity if they differ.
+    void process(const SampleRingBuffer &src, int count, SampleRingBuffer &dst, int capacity);
+
+    // Width of the band stop around BSF
+    static constexpr double NotchWidthHz = 4;
+
+private:
+    typedef struct
+    {
+        double b0, b1, b2, a1, a2;
+    } Stage;
+
+    double m_LPF, m_HPF, m_BSF;
+    int m_channels;
+    double m_sampleRate;
+    bool m_primed;
+
+    QVector<Stage> m_stages;
+    QVector<double> m_z1, m_z2;     // stages x channels, transposed direct form II state
+    QVector<double> m_block;        // samples x channels scratch
+
+    void updateStages();
+};
+
+#endif // FILTERBANK_H
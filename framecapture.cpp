@@ -0,0 +1,264 @@
+#include "framecapture.h"
+#include "neuroplaypro.h"
+#include <QDateTime>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+using namespace FrameCapture;
+
+namespace
+{
+
+const char FileMagic[] = "NPCAP001";
+const char TrailerMagic[] = "NPCAPIDX";
+const int MagicSize = 8;
+const int FileHeaderSize = MagicSize + 8;
+const int FrameHeaderSize = 4 + 1 + 8;
+const int TrailerSize = 4 + 8 + MagicSize;
+
+} // namespace
+
+// ======================= FrameCaptureWriter ===================== //
+
+FrameCaptureWriter::FrameCaptureWriter(QObject *parent) : QObject(parent),
+    m_frames(4096),
+    m_droppedFrames(0),
+    m_offset(0)
+{
+    m_clock.start();
+}
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    close();
+}
+
+void FrameCaptureWriter::capture(Direction direction, const QByteArray &frame)
+{
+    Frame f;
+    f.direction = direction;
+    f.timeUs = m_clock.nsecsElapsed() / 1000;
+    f.data = frame;
+    if (!m_frames.push(f))
+    {
+        m_droppedFrames.fetchAndAddRelaxed(1);
+        return;
+    }
+    QMetaObject::invokeMethod(this, "writePending", Qt::QueuedConnection);
+}
+
+void FrameCaptureWriter::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        emit error(QString("can't write %1: %2").arg(fileName, m_file.errorString()));
+        return;
+    }
+    uchar header[FileHeaderSize];
+    memcpy(header, FileMagic, MagicSize);
+    // wall clock of the moment the monotonic clock was started
+    qint64 start = QDateTime::currentMSecsSinceEpoch() - m_clock.elapsed();
+    qToLittleEndian<qint64>(start, header + MagicSize);
+    m_file.write(reinterpret_cast<const char *>(header), FileHeaderSize);
+    m_offset = FileHeaderSize;
+    m_index.clear();
+}
+
+void FrameCaptureWriter::writePending()
+{
+    Frame f;
+    while (m_frames.pop(f))
+    {
+        if (!m_file.isOpen())
+            continue;
+        if (m_index.isEmpty() || f.timeUs - m_index.last().timeUs >= IndexIntervalUs)
+        {
+            IndexEntry entry;
+            entry.timeUs = f.timeUs;
+            entry.offset = m_offset;
+            m_index << entry;
+        }
+        uchar header[FrameHeaderSize];
+        qToLittleEndian<quint32>(quint32(f.data.size()), header);
+        header[4] = quint8(f.direction);
+        qToLittleEndian<qint64>(f.timeUs, header + 5);
+        m_file.write(reinterpret_cast<const char *>(header), FrameHeaderSize);
+        m_file.write(f.data);
+        m_offset += FrameHeaderSize + f.data.size();
+    }
+}
+
+void FrameCaptureWriter::close()
+{
+    if (!m_file.isOpen())
+        return;
+    writePending();
+
+    QByteArray index(m_index.size() * 16 + TrailerSize, Qt::Uninitialized);
+    uchar *p = reinterpret_cast<uchar *>(index.data());
+    for (const IndexEntry &entry: m_index)
+    {
+        qToLittleEndian<qint64>(entry.timeUs, p);
+        qToLittleEndian<qint64>(entry.offset, p + 8);
+        p += 16;
+    }
+    qToLittleEndian<quint32>(quint32(m_index.size()), p);
+    qToLittleEndian<qint64>(m_offset, p + 4);
+    memcpy(p + 12, TrailerMagic, MagicSize);
+    m_file.write(index);
+    m_file.close();
+}
+
+// ======================= FrameCaptureReader ===================== //
+
+FrameCaptureReader::FrameCaptureReader() :
+    m_data(nullptr),
+    m_size(0),
+    m_framesEnd(0),
+    m_pos(0),
+    m_startTime(0)
+{
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+    close();
+}
+
+bool FrameCaptureReader::open(const QString &fileName)
+{
+    close();
+    m_error.clear();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        m_error = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = (m_size >= FileHeaderSize)? m_file.map(0, m_size): nullptr;
+    if (!m_data || memcmp(m_data, FileMagic, MagicSize))
+    {
+        m_error = m_data? "not a capture file": m_file.errorString();
+        close();
+        return false;
+    }
+    m_startTime = qFromLittleEndian<qint64>(m_data + MagicSize);
+
+    // the index written by close(), if it is there and consistent
+    m_framesEnd = m_size;
+    m_index.clear();
+    const uchar *trailer = (m_size >= FileHeaderSize + TrailerSize)? m_data + m_size - TrailerSize: nullptr;
+    if (trailer && !memcmp(trailer + 12, TrailerMagic, MagicSize))
+    {
+        quint32 count = qFromLittleEndian<quint32>(trailer);
+        qint64 offset = qFromLittleEndian<qint64>(trailer + 4);
+        if (offset >= FileHeaderSize && offset + qint64(count) * 16 + TrailerSize == m_size)
+        {
+            m_framesEnd = offset;
+            m_index.resize(int(count));
+            for (int i=0; i<int(count); i++)
+            {
+                m_index[i].timeUs = qFromLittleEndian<qint64>(m_data + offset + i * 16);
+                m_index[i].offset = qFromLittleEndian<qint64>(m_data + offset + i * 16 + 8);
+            }
+        }
+    }
+    if (m_framesEnd == m_size)
+        rebuildIndex();
+    m_pos = FileHeaderSize;
+    return true;
+}
+
+void FrameCaptureReader::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+    m_data = nullptr;
+    m_file.close();
+    m_index.clear();
+    m_size = 0;
+    m_framesEnd = 0;
+    m_pos = 0;
+}
+
+void FrameCaptureReader::seek(qint64 timeUs)
+{
+    if (!isOpen())
+        return;
+    // the last index entry not after timeUs
+    auto it = std::upper_bound(m_index.constBegin(), m_index.constEnd(), timeUs,
+                               [](qint64 t, const IndexEntry &entry) {return t < entry.timeUs;});
+    m_pos = (it == m_index.constBegin())? FileHeaderSize: (it - 1)->offset;
+
+    Frame frame;
+    qint64 nextPos;
+    while (readFrame(m_pos, frame, nextPos) && frame.timeUs < timeUs)
+        m_pos = nextPos;
+}
+
+bool FrameCaptureReader::next(Frame &frame)
+{
+    qint64 nextPos;
+    if (!isOpen() || !readFrame(m_pos, frame, nextPos))
+        return false;
+    m_pos = nextPos;
+    return true;
+}
+
+int FrameCaptureReader::replay(NeuroplayPro *pro, qint64 untilUs)
+{
+    int count = 0;
+    Frame frame;
+    qint64 nextPos;
+    while (isOpen() && readFrame(m_pos, frame, nextPos))
+    {
+        if (untilUs >= 0 && frame.timeUs > untilUs)
+            break;
+        m_pos = nextPos;
+        if (frame.direction != Incoming)
+            continue;
+        // frame data points into the file mapping, the receivers may keep it past close()
+        QByteArray data(frame.data.constData(), frame.data.size());
+        QMetaObject::invokeMethod(pro, "onSocketFrame", Qt::DirectConnection, Q_ARG(QByteArray, data));
+        count++;
+    }
+    return count;
+}
+
+bool FrameCaptureReader::readFrame(qint64 pos, Frame &frame, qint64 &nextPos) const
+{
+    if (pos + FrameHeaderSize > m_framesEnd)
+        return false;
+    const uchar *p = m_data + pos;
+    quint32 size = qFromLittleEndian<quint32>(p);
+    // a frame cut off by a crash ends the capture
+    if (pos + FrameHeaderSize + qint64(size) > m_framesEnd)
+        return false;
+    frame.direction = Direction(p[4]);
+    frame.timeUs = qFromLittleEndian<qint64>(p + 5);
+    frame.data = QByteArray::fromRawData(reinterpret_cast<const char *>(p + FrameHeaderSize), int(size));
+    nextPos = pos + FrameHeaderSize + size;
+    return true;
+}
+
+void FrameCaptureReader::rebuildIndex()
+{
+    m_index.clear();
+    Frame frame;
+    qint64 pos = FileHeaderSize, nextPos;
+    while (readFrame(pos, frame, nextPos))
+    {
+        if (m_index.isEmpty() || frame.timeUs - m_index.last().timeUs >= IndexIntervalUs)
+        {
+            IndexEntry entry;
+            entry.timeUs = frame.timeUs;
+            entry.offset = pos;
+            m_index << entry;
+        }
+        pos = nextPos;
+    }
+}
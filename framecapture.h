@@ -0,0 +1,113 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QObject>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QAtomicInteger>
+#include "spscqueue.h"
+
+class NeuroplayPro;
+
+// Capture file of WebSocket traffic:
+//   header:  "NPCAP001", capture start (qint64, ms since epoch)
+//   frames:  payload size (quint32), direction (quint8), time since start (qint64, us), payload (UTF-8)
+//   index:   entries of (time, file offset) (qint64 each), one per IndexIntervalUs of traffic
+//   trailer: index entry count (quint32), index offset (qint64), "NPCAPIDX"
+// All numbers are little-endian. A file without the trailer (e.g. after a crash) is still
+// readable, its index is rebuilt by a scan.
+namespace FrameCapture
+{
+    enum Direction {Incoming, Outgoing};
+
+    typedef struct
+    {
+        Direction direction;
+        qint64 timeUs;
+        QByteArray data;
+    } Frame;
+
+    typedef struct
+    {
+        qint64 timeUs;
+        qint64 offset;
+    } IndexEntry;
+
+    const qint64 IndexIntervalUs = 1000000;
+}
+
+// Appends frames to a capture file from a background thread.
+// capture() is called by the thread that sees the traffic; the writer object itself
+// lives in its own thread and is driven by queued writePending() calls.
+class FrameCaptureWriter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FrameCaptureWriter(QObject *parent = nullptr);
+    virtual ~FrameCaptureWriter();
+
+    // Producer side, must be called from a single thread
+    void capture(FrameCapture::Direction direction, const QByteArray &frame);
+    // Counted by the producer thread, readable from any
+    quint64 droppedFrames() const {return m_droppedFrames.loadAcquire();}
+
+public slots:
+    void open(const QString &fileName);
+    void writePending();
+    void close();
+
+signals:
+    void error(QString text);
+
+private:
+    SpscQueue<FrameCapture::Frame> m_frames;
+    QElapsedTimer m_clock;
+    QAtomicInteger<quint64> m_droppedFrames;
+
+    QFile m_file;
+    qint64 m_offset;
+    QVector<FrameCapture::IndexEntry> m_index;
+};
+
+// Reads a capture file through a memory mapping; frame data points into the mapping
+// and stays valid until close().
+class FrameCaptureReader
+{
+public:
+    FrameCaptureReader();
+    ~FrameCaptureReader();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const {return m_data != nullptr;}
+    QString errorString() const {return m_error;}
+
+    qint64 startTime() const {return m_startTime;}
+    const QVector<FrameCapture::IndexEntry> &index() const {return m_index;}
+
+    // Positions the reader at the first frame at or after timeUs:
+    // a binary search over the index and a scan of at most one index interval
+    void seek(qint64 timeUs);
+    bool next(FrameCapture::Frame &frame);
+
+    // Feeds the incoming frames up to untilUs (all if negative) into pro as if they came
+    // from its socket; outgoing frames are skipped. Each frame is copied out of the mapping,
+    // so pro may keep it after close(). Returns the number of frames fed.
+    int replay(NeuroplayPro *pro, qint64 untilUs = -1);
+
+private:
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_framesEnd;
+    qint64 m_pos;
+    qint64 m_startTime;
+    QVector<FrameCapture::IndexEntry> m_index;
+    QString m_error;
+
+    bool readFrame(qint64 pos, FrameCapture::Frame &frame, qint64 &nextPos) const;
+    void rebuildIndex();
+};
+
+#endif // FRAMECAPTURE_H
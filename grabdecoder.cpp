@@ -0,0 +1,338 @@
+#include "grabdecoder.h"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+
+inline const char *skipSpace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// Returns the position right after the closing quote of the string starting at p
+const char *skipString(const char *p, const char *end)
+{
+    for (p++; p < end; p++)
+    {
+        if (*p == '\\')
+            p++;
+        else if (*p == '"')
+            return p + 1;
+    }
+    return nullptr;
+}
+
+const char *skipValue(const char *p, const char *end)
+{
+    if (p >= end)
+        return nullptr;
+    if (*p == '"')
+        return skipString(p, end);
+    if (*p == '[' || *p == '{')
+    {
+        int depth = 0;
+        while (p < end)
+        {
+            if (*p == '"')
+            {
+                p = skipString(p, end);
+                if (!p)
+                    return nullptr;
+                continue;
+            }
+            if (*p == '[' || *p == '{')
+                depth++;
+            else if ((*p == ']' || *p == '}') && --depth == 0)
+                return p + 1;
+            p++;
+        }
+        return nullptr;
+    }
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+        p++;
+    return p;
+}
+
+// Returns the position of the value of a member of the object starting at p, or nullptr
+const char *findObjectMember(const char *p, const char *end, const char *key)
+{
+    p = skipSpace(p, end);
+    if (p >= end || *p != '{')
+        return nullptr;
+    size_t keySize = strlen(key);
+    p++;
+    for (;;)
+    {
+        p = skipSpace(p, end);
+        if (p >= end || *p != '"')
+            return nullptr;
+        const char *name = p + 1;
+        p = skipString(p, end);
+        if (!p)
+            return nullptr;
+        size_t nameSize = size_t(p - 1 - name);
+        p = skipSpace(p, end);
+        if (p >= end || *p != ':')
+            return nullptr;
+        p = skipSpace(p + 1, end);
+        if (nameSize == keySize && !memcmp(name, key, keySize))
+            return p;
+
+        p = skipValue(p, end);
+        if (!p)
+            return nullptr;
+        p = skipSpace(p, end);
+        if (p >= end || *p != ',')
+            return nullptr;
+        p++;
+    }
+}
+
+// Returns the position of the value of a top-level member of the frame object, or nullptr
+const char *findMember(const QByteArray &frame, const char *key)
+{
+    return findObjectMember(frame.constData(), frame.constData() + frame.size(), key);
+}
+
+const int MalformedFrame = -1;
+
+// Parses [[...], [...], ...] into values, channel after channel, each cut or padded with zeros
+// to the sample count of the first channel. Returns that count, channels gets the channel count.
+// Nothing reaches the ring buffer here, so a malformed frame can't overwrite its oldest samples.
+int decodeMatrix(const char *p, const char *end, QVector<double> &values, int &channels)
+{
+    values.resize(0);
+    channels = 0;
+    if (p >= end || *p != '[')
+        return MalformedFrame;
+    p = skipSpace(p + 1, end);
+    if (p < end && *p == ']')
+        return 0;
+
+    int count = 0;
+    for (;;)
+    {
+        if (p >= end || *p != '[')
+            return MalformedFrame;
+        p = skipSpace(p + 1, end);
+
+        int n = 0;
+        if (p < end && *p != ']')
+        {
+            for (;;)
+            {
+                double value;
+                if (!GrabDecoder::parseNumber(p, end, value))
+                    return MalformedFrame;
+                if (!channels || n < count)
+                    values << value;
+                n++;
+                p = skipSpace(p, end);
+                if (p < end && *p == ',')
+                {
+                    p = skipSpace(p + 1, end);
+                    continue;
+                }
+                break;
+            }
+        }
+        if (p >= end || *p != ']')
+            return MalformedFrame;
+
+        if (!channels)
+            count = n;
+        for (; n < count; n++)
+            values << 0;
+
+        channels++;
+        p = skipSpace(p + 1, end);
+        if (p < end && *p == ',')
+        {
+            p = skipSpace(p + 1, end);
+            continue;
+        }
+        if (p < end && *p == ']')
+            break;
+        return MalformedFrame;
+    }
+    return count;
+}
+
+} // namespace
+
+QString GrabDecoder::peekCommand(const QByteArray &frame)
+{
+    const char *p = findMember(frame, "command");
+    const char *end = frame.constData() + frame.size();
+    if (!p || p >= end || *p != '"')
+        return QString();
+    const char *stop = skipString(p, end);
+    if (!stop)
+        return QString();
+    return QString::fromUtf8(p + 1, int(stop - 1 - (p + 1)));
+}
+
+bool GrabDecoder::isSampleFrame(const QString &cmd, const QByteArray &frame)
+{
+    return (cmd == "grabfiltereddata" || cmd == "grabrawdata") && !frame.contains("\"error\"");
+}
+
+int GrabDecoder::decodeData(const QByteArray &frame, SampleRingBuffer &buffer, int capacity)
+{
+    const char *p = findMember(frame, "data");
+    const char *end = frame.constData() + frame.size();
+    if (!p)
+        return MalformedFrame;
+
+    // staging keeps its allocation between frames; decoding runs on the GUI and socket threads
+    thread_local QVector<double> values;
+    int channels;
+    int count = decodeMatrix(p, end, values, channels);
+    if (count < 0)
+        return MalformedFrame;
+    if (channels > 0 && channels != buffer.channels())
+    {
+        // channel mode has changed, happens once per device start
+        buffer.reset(channels, capacity);
+    }
+
+    const double *src = values.constData();
+    for (int j=0; j<channels; j++)
+    {
+        SampleRingBuffer::Writer w = buffer.writer(j);
+        for (int i=0; i<count; i++)
+            w.put(*src++);
+    }
+    buffer.commit(count);
+    return count;
+}
+
+QVector<GrabDecoder::StringRef> GrabDecoder::recordFiles(const QByteArray &frame)
+{
+    QVector<StringRef> files;
+    const char *begin = frame.constData();
+    const char *end = begin + frame.size();
+    const char *p = findMember(frame, "files");
+    if (!p || p >= end || *p != '[')
+        return files;
+
+    p = skipSpace(p + 1, end);
+    while (p < end && *p == '{')
+    {
+        const char *type = findObjectMember(p, end, "type");
+        const char *data = findObjectMember(p, end, "data");
+        const char *typeEnd = (type && *type == '"')? skipString(type, end): nullptr;
+        const char *dataEnd = (data && *data == '"')? skipString(data, end): nullptr;
+        if (typeEnd && dataEnd)
+        {
+            StringRef file;
+            file.name = QString::fromUtf8(type + 1, int(typeEnd - 1 - (type + 1)));
+            file.offset = int(data + 1 - begin);
+            file.size = int(dataEnd - 1 - (data + 1));
+            files << file;
+        }
+        p = skipValue(p, end);
+        if (!p)
+            break;
+        p = skipSpace(p, end);
+        if (p < end && *p == ',')
+            p = skipSpace(p + 1, end);
+    }
+    return files;
+}
+
+bool GrabDecoder::parseNumber(const char *&p, const char *end, double &value)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *s = p;
+    if (end - s >= 4 && !memcmp(s, "null", 4))
+    {
+        value = 0;
+        p = s + 4;
+        return true;
+    }
+
+    bool negative = false;
+    if (s < end && *s == '-')
+    {
+        negative = true;
+        s++;
+    }
+
+    // up to 19 significant digits fit into the 64-bit mantissa
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    while (s < end && *s >= '0' && *s <= '9')
+    {
+        any = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + quint64(*s - '0');
+            if (mantissa)
+                digits++;
+        }
+        else
+        {
+            exponent++;
+        }
+        s++;
+    }
+    if (s < end && *s == '.')
+    {
+        s++;
+        while (s < end && *s >= '0' && *s <= '9')
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + quint64(*s - '0');
+                if (mantissa)
+                    digits++;
+                exponent--;
+            }
+            s++;
+        }
+    }
+    if (!any)
+        return false;
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        s++;
+        bool expNegative = false;
+        if (s < end && (*s == '-' || *s == '+'))
+            expNegative = (*s++ == '-');
+        int e = 0;
+        bool expAny = false;
+        while (s < end && *s >= '0' && *s <= '9')
+        {
+            expAny = true;
+            if (e < 10000)
+                e = e * 10 + (*s - '0');
+            s++;
+        }
+        if (!expAny)
+            return false;
+        exponent += expNegative? -e: e;
+    }
+
+    // exact for mantissa < 2^53 and |exponent| <= 22, which covers EEG values
+    double v = double(mantissa);
+    if (exponent < 0)
+        v = (exponent >= -22)? v / pow10[-exponent]: v * std::pow(10.0, exponent);
+    else if (exponent > 0)
+        v = (exponent <= 22)? v * pow10[exponent]: v * std::pow(10.0, exponent);
+
+    value = negative? -v: v;
+    p = s;
+    return true;
+}
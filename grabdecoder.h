@@ -0,0 +1,42 @@
+#ifndef GRABDECODER_H
+#define GRABDECODER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "samplebuffer.h"
+
+// Streaming decoder for the numeric payloads of NeuroPlayPro responses.
+// Works on the raw UTF-8 frame, without building QJsonDocument/QJsonArray trees.
+class GrabDecoder
+{
+public:
+    // Value of the top-level "command" field, or empty string if it was not found
+    static QString peekCommand(const QByteArray &frame);
+
+    // Grab responses with sample matrices, which should go through decodeData()
+    static bool isSampleFrame(const QString &cmd, const QByteArray &frame);
+
+    // Parses the "data" matrix ([[ch0 samples], [ch1 samples], ...]) into the buffer.
+    // The whole matrix is parsed before the buffer is written, so a full buffer keeps its oldest samples
+    // when the frame turns out to be malformed.
+    // The buffer is reset to the frame's channel count with the given capacity if they differ.
+    // Returns the number of samples appended, or -1 if the frame is malformed (nothing is appended then).
+    static int decodeData(const QByteArray &frame, SampleRingBuffer &buffer, int capacity);
+
+    // Location of a string value inside the frame, quotes excluded, escapes not resolved
+    typedef struct
+    {
+        QString name;
+        int offset;
+        int size;
+    } StringRef;
+
+    // The "data" strings of the stoprecord "files" array, named by their "type"
+    static QVector<StringRef> recordFiles(const QByteArray &frame);
+
+    // Locale-independent JSON number parser, advances p past the number
+    static bool parseNumber(const char *&p, const char *end, double &value);
+};
+
+#endif // GRABDECODER_H
@@ -0,0 +1,148 @@
+#include "grabscheduler.h"
+#include "requestqueue.h"
+
+GrabScheduler::GrabScheduler(QObject *parent) : QObject(parent),
+    m_intervalMs(50)
+{
+    for (int i=0; i<StreamCount; i++)
+    {
+        State &s = m_streams[i];
+        s.enabled = false;
+        s.pending = false;
+        s.requestTime = 0;
+        s.lastResponseTime = 0;
+        s.nextPollTime = 0;
+        s.intervalMs = m_intervalMs;
+        s.roundTripMs = 0;
+        s.latencyMs = 0;
+        s.polls = 0;
+        s.emptyPolls = 0;
+    }
+    m_timer = new QTimer(this);
+    m_timer->setInterval(m_intervalMs);
+    connect(m_timer, &QTimer::timeout, this, &GrabScheduler::onTick);
+}
+
+void GrabScheduler::setEnabled(Stream stream, bool enable)
+{
+    State &s = m_streams[stream];
+    if (enable && !s.enabled)
+    {
+        s.pending = false;
+        s.lastResponseTime = 0;
+        s.nextPollTime = 0;
+        s.intervalMs = m_intervalMs;
+    }
+    s.enabled = enable;
+}
+
+bool GrabScheduler::hasEnabledStreams() const
+{
+    for (int i=0; i<StreamCount; i++)
+        if (m_streams[i].enabled)
+            return true;
+    return false;
+}
+
+void GrabScheduler::setInterval(int value_ms)
+{
+    m_intervalMs = qMax(value_ms, 1);
+    m_timer->setInterval(m_intervalMs);
+    for (int i=0; i<StreamCount; i++)
+    {
+        State &s = m_streams[i];
+        if (i == FilteredDataStream || i == RawDataStream)
+        {
+            // the sample streams run at the configured interval from the next poll on
+            s.intervalMs = m_intervalMs;
+            s.nextPollTime = qMin(s.nextPollTime, s.requestTime + m_intervalMs);
+        }
+        else
+        {
+            s.intervalMs = qMax(s.intervalMs, double(m_intervalMs));
+        }
+    }
+}
+
+void GrabScheduler::start()
+{
+    m_timer->start(m_intervalMs);
+}
+
+void GrabScheduler::stop()
+{
+    m_timer->stop();
+    for (int i=0; i<StreamCount; i++)
+        m_streams[i].pending = false;
+}
+
+void GrabScheduler::received(Stream stream, int count)
+{
+    State &s = m_streams[stream];
+    qint64 now = RequestQueue::clock();
+    if (!s.pending)
+        return;
+    s.pending = false;
+
+    double rtt = double(now - s.requestTime);
+    s.roundTripMs = (s.polls > 1)? 0.8 * s.roundTripMs + 0.2 * rtt: rtt;
+
+    if (count > 0)
+    {
+        if (s.lastResponseTime > 0)
+        {
+            // the entries have been accumulating since the previous non-empty response
+            double span = double(now - s.lastResponseTime);
+            double target = qBound(double(m_intervalMs), span / count, double(MaxIntervalMs));
+            s.intervalMs = 0.7 * s.intervalMs + 0.3 * target;
+            // entries spread evenly over the span are half of it old when polled, the response takes half the round trip
+            double latency = 0.5 * (span + rtt);
+            s.latencyMs = (s.latencyMs > 0)? 0.8 * s.latencyMs + 0.2 * latency: latency;
+        }
+        s.lastResponseTime = now;
+    }
+    else
+    {
+        s.emptyPolls++;
+        s.intervalMs = qMin(s.intervalMs * 1.5, double(MaxIntervalMs));
+    }
+    s.nextPollTime = s.requestTime + qint64(s.intervalMs);
+}
+
+GrabScheduler::Stats GrabScheduler::stats(Stream stream) const
+{
+    const State &s = m_streams[stream];
+    Stats stats;
+    stats.intervalMs = s.intervalMs;
+    stats.roundTripMs = s.roundTripMs;
+    stats.latencyMs = s.latencyMs;
+    stats.polls = s.polls;
+    stats.emptyPolls = s.emptyPolls;
+    return stats;
+}
+
+void GrabScheduler::onTick()
+{
+    qint64 now = RequestQueue::clock();
+    for (int i=0; i<StreamCount; i++)
+    {
+        State &s = m_streams[i];
+        if (!s.enabled)
+            continue;
+        if (s.pending)
+        {
+            if (!RequestQueue::isExpired(s.requestTime, now))
+                continue;
+            // the response is lost, poll again
+            s.pending = false;
+        }
+        if (now < s.nextPollTime)
+            continue;
+
+        s.pending = true;
+        s.polls++;
+        emit poll(i);
+        // taken after the request is queued, so the queue expires it no later than we retry
+        s.requestTime = RequestQueue::clock();
+    }
+}
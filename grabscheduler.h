@@ -0,0 +1,76 @@
+#ifndef GRABSCHEDULER_H
+#define GRABSCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+
+// Poll scheduler for grab mode.
+// NeuroPlayPro has no push subscriptions, so each stream is polled on its own interval,
+// adapted to the rate the data actually arrives with: slow streams (meditation, rhythms)
+// are not polled when nothing new can be there, sample streams run at the configured interval.
+// A stream is never polled again while its previous request is still unanswered
+// and not yet expired by the RequestQueue.
+class GrabScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stream {FilteredDataStream, RawDataStream, RhythmsStream, MeditationStream, ConcentrationStream, StreamCount};
+
+    typedef struct
+    {
+        double intervalMs;      // current poll interval
+        double roundTripMs;     // request to response time
+        double latencyMs;       // estimated average age of the data at delivery: half of the time the entries
+                                // accumulated plus half the round trip, not measured per entry
+        int polls;
+        int emptyPolls;
+    } Stats;
+
+    explicit GrabScheduler(QObject *parent = nullptr);
+
+    void setEnabled(Stream stream, bool enable);
+    bool isEnabled(Stream stream) const {return m_streams[stream].enabled;}
+    bool hasEnabledStreams() const;
+
+    // Shortest poll interval, used for the sample streams
+    void setInterval(int value_ms);
+    int interval() const {return m_intervalMs;}
+
+    void start();
+    void stop();
+    bool isActive() const {return m_timer->isActive();}
+
+    // Must be called for each response to a poll, with the number of new entries in it
+    void received(Stream stream, int count);
+
+    Stats stats(Stream stream) const;
+
+    static const int MaxIntervalMs = 1000;
+
+signals:
+    void poll(int stream);
+
+private slots:
+    void onTick();
+
+private:
+    typedef struct
+    {
+        bool enabled;
+        bool pending;
+        qint64 requestTime;
+        qint64 lastResponseTime;
+        qint64 nextPollTime;
+        double intervalMs;
+        double roundTripMs;
+        double latencyMs;
+        int polls;
+        int emptyPolls;
+    } State;
+
+    State m_streams[StreamCount];
+    QTimer *m_timer;
+    int m_intervalMs;
+};
+
+#endif // GRABSCHEDULER_H
@@ -1,9 +1,17 @@
 #include "mainwindow.h"
+#include "metrics.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // e.g. NEUROPLAY_METRICS_PORT=9136, then curl localhost:9136/metrics
+    MetricsServer metricsServer;
+    int metricsPort = qEnvironmentVariableIntValue("NEUROPLAY_METRICS_PORT");
+    if (metricsPort > 0 && !metricsServer.listen(quint16(metricsPort)))
+        qWarning() << "can't serve metrics on port" << metricsPort;
+
     MainWindow w;
     w.show();
 
@@ -43,14 +43,37 @@ MainWindow::MainWindow(QWidget *parent) :
 
     ui->statusBar->addWidget(status);
 
+    metricsStatus = new QLabel;
+    ui->statusBar->addPermanentWidget(metricsStatus);
+    metrics = new MetricsMonitor(1000, this);
+    connect(metrics, &MetricsMonitor::updated, [=]()
+    {
+        metricsStatus->setText(QString("rx %1 kB/s, %2 frames/s, decode %3 us, rtt %4 ms, paint %5 us (p50)")
+            .arg(metrics->rate("neuroplay_socket_received_bytes_total") / 1024, 0, 'f', 1)
+            .arg(metrics->totalRate("neuroplay_frames_total"), 0, 'f', 0)
+            .arg(metrics->percentile("neuroplay_frame_decode_us", 0.5))
+            .arg(metrics->percentile("neuroplay_request_round_trip_us", 0.5) / 1000)
+            .arg(metrics->percentile("neuroplay_chart_paint_us", 0.5)));
+    });
+
     QPushButton *btnGraphs = new QPushButton("Graphs");
     QPushButton *btnSpectrum = new QPushButton("Spectrum");
     QPushButton *btnMeditation = new QPushButton("Meditation");
+    QPushButton *btnLive = new QPushButton("Live");
+    btnLive->setCheckable(true);
+    // changes the storage time of the server, for all its clients, until the device is stopped
+    QPushButton *btnAdaptive = new QPushButton("Adaptive grab");
+    btnAdaptive->setCheckable(true);
+
+    QTimer *liveTimer = new QTimer(this);
+    liveTimer->setInterval(40);
 
     QVBoxLayout *layButtons = new QVBoxLayout;
     layButtons->addWidget(btnGraphs);
+    layButtons->addWidget(btnLive);
     layButtons->addWidget(btnSpectrum);
     layButtons->addWidget(btnMeditation);
+    layButtons->addWidget(btnAdaptive);
 
     QGridLayout *layout = new QGridLayout;
     ui->centralWidget->setLayout(layout);
@@ -90,24 +113,38 @@ MainWindow::MainWindow(QWidget *parent) :
             modeItem->setData(1, 43, device->channelModesValues()[i].first);
         }
 
+        // the connections made on ready live in a context replaced on each start, so restarts don't stack them
+        QObject *contexts = new QObject(device);
         connect(device, &NeuroplayDevice::ready, [=]()
         {
             item->setBackgroundColor(0, Qt::green);
             item->setText(1, "started");
+            qDeleteAll(contexts->children());
+            QObject *context = new QObject(contexts);
+            // the 5 s storage time set on connect is raised if the polls can't keep up
+            device->setAdaptiveGrab(btnAdaptive->isChecked());
+            connect(btnAdaptive, &QPushButton::toggled, context, [=](bool checked)
+            {
+                device->setAdaptiveGrab(checked);
+            });
+            connect(device, &NeuroplayDevice::discontinuity, context, [=](bool filtered, int lost, int repeated)
+            {
+                log->append(QString("%1 data: %2 samples lost, %3 repeated").arg(filtered? "filtered": "raw").arg(lost).arg(repeated));
+            });
 
-            connect(btnSpectrum, &QPushButton::clicked, [=]()
+            connect(btnSpectrum, &QPushButton::clicked, context, [=]()
             {
                 device->requestSpectrum();
             });
 
-            connect(btnGraphs, &QPushButton::clicked, [=]()
+            connect(btnGraphs, &QPushButton::clicked, context, [=]()
             {
                 device->requestFilteredData();
                 //device->requestRawData();
             });
 
             //---------------------
-            connect(device, &NeuroplayDevice::spectrumReady, [=]()
+            connect(device, &NeuroplayDevice::spectrumReady, context, [=]()
             {
                 //Spectrum is updated each 0.1 seconds
                 NeuroplayDevice::ChannelsData spectrum = device->spectrum();
@@ -116,21 +153,37 @@ MainWindow::MainWindow(QWidget *parent) :
                 //qDebug() << spectrum;
             });
 
-            connect(device, &NeuroplayDevice::filteredDataReceived, [=](NeuroplayDevice::ChannelsData data)
+            connect(device, &NeuroplayDevice::filteredDataReceived, context, [=](NeuroplayDevice::ChannelsData data)
             {
                 qDebug() << "Filtered data:" << data.size() << "x" << (data.size()? data[0].size(): 0);
                 chart->setData(data, 200);
             });
 
 
-            connect(device, &NeuroplayDevice::rawDataReceived, [=](NeuroplayDevice::ChannelsData data)
+            connect(device, &NeuroplayDevice::rawDataReceived, context, [=](NeuroplayDevice::ChannelsData data)
             {
                 qDebug() << "Raw data:" << data.size() << "x" << (data.size()? data[0].size(): 0);
                 chart->setData(data, 100000);
             });
 
 
-            connect(btnMeditation, &QPushButton::clicked, [=]()
+            // grabbed samples scroll through the chart, 5 seconds per screen
+            connect(btnLive, &QPushButton::toggled, context, [=](bool checked)
+            {
+                device->grabFilteredData(checked);
+                chart->setScrolling(checked? 5 * device->sampleRate(): 0);
+                if (checked)
+                    liveTimer->start();
+                else
+                    liveTimer->stop();
+            });
+
+            connect(liveTimer, &QTimer::timeout, context, [=]()
+            {
+                chart->appendData(device->readFilteredDataHistory(), 200);
+            });
+
+            connect(btnMeditation, &QPushButton::clicked, context, [=]()
             {
                 device->requestMeditation();
                 chart->clear();
@@ -32,6 +32,8 @@ private:
     QTreeWidget *tree;
 
     QLabel *status;
+    QLabel *metricsStatus;
+    MetricsMonitor *metrics;
 };
 
 #endif // MAINWINDOW_H
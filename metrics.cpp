@@ -0,0 +1,311 @@
+#include "metrics.h"
+#include <QMutex>
+#include <QSet>
+#include <QTcpSocket>
+
+namespace
+{
+
+typedef struct
+{
+    QString name;
+    QString help;
+    NeuroplayMetrics::Kind kind;
+    void *metric;
+} Entry;
+
+struct Registry
+{
+    QMutex mutex;
+    QVector<Entry> entries;
+    QHash<QString, int> index;
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+
+template <typename T>
+T *registered(const QString &name, const QString &help, NeuroplayMetrics::Kind kind)
+{
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+    int i = r.index.value(name, -1);
+    if (i >= 0)
+    {
+        Q_ASSERT(r.entries[i].kind == kind);
+        return static_cast<T *>(r.entries[i].metric);
+    }
+    Entry entry;
+    entry.name = name;
+    entry.help = help;
+    entry.kind = kind;
+    entry.metric = new T;
+    r.index[name] = r.entries.size();
+    r.entries << entry;
+    return static_cast<T *>(entry.metric);
+}
+
+// name{labels} with extra labels added
+QByteArray labelled(const QString &name, const QString &labels, const QString &extra = QString())
+{
+    QString all = labels;
+    if (!extra.isEmpty())
+        all += (all.isEmpty()? "": ",") + extra;
+    return (all.isEmpty()? name: name + "{" + all + "}").toUtf8();
+}
+
+// Escapes for the text format: backslash and line feed everywhere, double quote in label values
+QString escaped(QString text, bool quotes)
+{
+    text.replace("\\", "\\\\");
+    text.replace("\n", "\\n");
+    if (quotes)
+        text.replace("\"", "\\\"");
+    return text;
+}
+
+} // namespace
+
+// ======================= MetricsHistogram ======================= //
+
+void MetricsHistogram::record(qint64 us)
+{
+    quint64 value = quint64(qMax(us, qint64(0)));
+    int i = 0;
+    while (i < Buckets - 1 && value >= quint64(upperBound(i)))
+        i++;
+    m_buckets[i].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(value);
+}
+
+// ======================= NeuroplayMetrics ======================= //
+
+MetricsCounter *NeuroplayMetrics::counter(const QString &name, const QString &help)
+{
+    return registered<MetricsCounter>(name, help, Counter);
+}
+
+MetricsGauge *NeuroplayMetrics::gauge(const QString &name, const QString &help)
+{
+    return registered<MetricsGauge>(name, help, Gauge);
+}
+
+MetricsHistogram *NeuroplayMetrics::histogram(const QString &name, const QString &help)
+{
+    return registered<MetricsHistogram>(name, help, Histogram);
+}
+
+QString NeuroplayMetrics::name(const QString &base, const QString &label, const QString &value)
+{
+    return QString("%1{%2=\"%3\"}").arg(base, label, escaped(value, true));
+}
+
+QVector<NeuroplayMetrics::Sample> NeuroplayMetrics::snapshot()
+{
+    Registry &r = registry();
+    QMutexLocker lock(&r.mutex);
+    QVector<Sample> samples;
+    samples.reserve(r.entries.size());
+    for (const Entry &entry: r.entries)
+    {
+        Sample s;
+        s.name = entry.name;
+        s.kind = entry.kind;
+        s.sum = 0;
+        switch (entry.kind)
+        {
+        case Counter:
+            s.value = static_cast<MetricsCounter *>(entry.metric)->value();
+            break;
+        case Gauge:
+            s.value = static_cast<MetricsGauge *>(entry.metric)->value();
+            break;
+        case Histogram:
+        {
+            MetricsHistogram *h = static_cast<MetricsHistogram *>(entry.metric);
+            s.value = h->count();
+            s.sum = h->sum();
+            s.buckets.resize(MetricsHistogram::Buckets);
+            for (int i=0; i<MetricsHistogram::Buckets; i++)
+                s.buckets[i] = h->bucket(i);
+            break;
+        }
+        }
+        samples << s;
+    }
+    return samples;
+}
+
+QByteArray NeuroplayMetrics::text()
+{
+    QHash<QString, QString> help;
+    {
+        Registry &r = registry();
+        QMutexLocker lock(&r.mutex);
+        for (const Entry &entry: r.entries)
+            help[entry.name] = entry.help;
+    }
+
+    QByteArray out;
+    QSet<QString> described;
+    for (const Sample &s: snapshot())
+    {
+        QString base = s.name.section('{', 0, 0);
+        QString labels = (s.name.size() > base.size())? s.name.mid(base.size() + 1, s.name.size() - base.size() - 2): QString();
+        if (!described.contains(base))
+        {
+            described << base;
+            if (!help[s.name].isEmpty())
+                out += "# HELP " + base.toUtf8() + " " + escaped(help[s.name], false).toUtf8() + "\n";
+            out += "# TYPE " + base.toUtf8() + ((s.kind == Counter)? " counter\n": (s.kind == Gauge)? " gauge\n": " histogram\n");
+        }
+
+        if (s.kind != Histogram)
+        {
+            out += labelled(base, labels) + " " + QByteArray::number(s.value, 'g', 15) + "\n";
+            continue;
+        }
+        // cumulative buckets up to the last used one
+        int last = s.buckets.size() - 1;
+        while (last > 0 && !s.buckets[last])
+            last--;
+        quint64 cumulative = 0;
+        for (int i=0; i<=last; i++)
+        {
+            cumulative += s.buckets[i];
+            QString le = QString("le=\"%1\"").arg(MetricsHistogram::upperBound(i));
+            out += labelled(base + "_bucket", labels, le) + " " + QByteArray::number(cumulative) + "\n";
+        }
+        out += labelled(base + "_bucket", labels, "le=\"+Inf\"") + " " + QByteArray::number(s.value, 'g', 15) + "\n";
+        out += labelled(base + "_sum", labels) + " " + QByteArray::number(s.sum, 'g', 15) + "\n";
+        out += labelled(base + "_count", labels) + " " + QByteArray::number(s.value, 'g', 15) + "\n";
+    }
+    return out;
+}
+
+double NeuroplayMetrics::percentile(const QVector<quint64> &buckets, double p)
+{
+    quint64 total = 0;
+    for (quint64 n: buckets)
+        total += n;
+    if (!total)
+        return 0;
+    double target = p * total;
+    quint64 cumulative = 0;
+    for (int i=0; i<buckets.size(); i++)
+    {
+        cumulative += buckets[i];
+        if (cumulative >= target)
+            return MetricsHistogram::upperBound(i);
+    }
+    return MetricsHistogram::upperBound(buckets.size() - 1);
+}
+
+// ======================== MetricsMonitor ======================== //
+
+MetricsMonitor::MetricsMonitor(int intervalMs, QObject *parent) : QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setInterval(intervalMs);
+    connect(m_timer, &QTimer::timeout, this, &MetricsMonitor::sample);
+    m_timer->start();
+    m_clock.start();
+    sample();
+}
+
+double MetricsMonitor::value(const QString &name) const
+{
+    return m_last.value(name).value;
+}
+
+double MetricsMonitor::rate(const QString &name) const
+{
+    return m_rates.value(name);
+}
+
+double MetricsMonitor::totalRate(const QString &prefix) const
+{
+    double total = 0;
+    for (auto it = m_rates.constBegin(); it != m_rates.constEnd(); ++it)
+    {
+        if (it.key().startsWith(prefix))
+            total += it.value();
+    }
+    return total;
+}
+
+double MetricsMonitor::percentile(const QString &name, double p) const
+{
+    return NeuroplayMetrics::percentile(m_intervalBuckets.value(name), p);
+}
+
+void MetricsMonitor::sample()
+{
+    double seconds = m_clock.restart() / 1000.0;
+    for (const NeuroplayMetrics::Sample &s: NeuroplayMetrics::snapshot())
+    {
+        auto last = m_last.constFind(s.name);
+        if (last != m_last.constEnd())
+        {
+            if (s.kind == NeuroplayMetrics::Counter && seconds > 0)
+                m_rates[s.name] = (s.value - last->value) / seconds;
+            if (s.kind == NeuroplayMetrics::Histogram)
+            {
+                QVector<quint64> &buckets = m_intervalBuckets[s.name];
+                buckets.resize(s.buckets.size());
+                for (int i=0; i<s.buckets.size(); i++)
+                    buckets[i] = s.buckets[i] - last->buckets.value(i);
+            }
+        }
+        m_last[s.name] = s;
+    }
+    emit updated();
+}
+
+// ======================== MetricsServer ========================= //
+
+MetricsServer::MetricsServer(QObject *parent) : QObject(parent)
+{
+    m_server = new QTcpServer(this);
+    connect(m_server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections())
+    {
+        QTcpSocket *socket = m_server->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [=]()
+        {
+            if (socket->property("answered").toBool())
+            {
+                socket->readAll();
+                return;
+            }
+            // any request line gets the metrics; it may come in pieces, so wait for all of it
+            if (!socket->canReadLine())
+            {
+                if (socket->bytesAvailable() > MaxRequestLine)
+                    socket->abort();
+                return;
+            }
+            socket->readAll();
+            socket->setProperty("answered", true);
+            QByteArray body = NeuroplayMetrics::text();
+            socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                          + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n");
+            socket->write(body);
+            socket->disconnectFromHost();
+        });
+    }
+}
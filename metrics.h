@@ -0,0 +1,144 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QObject>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QHash>
+#include <QTimer>
+#include <QTcpServer>
+
+// Runtime metrics of the SDK, process-wide. A metric is registered by name once (under a lock)
+// and then updated through the returned pointer with relaxed atomics only, from any thread;
+// it lives as long as the process. Names follow the Prometheus conventions, labels are part
+// of the name, e.g. neuroplay_frames_total{command="grabrawdata"}.
+
+class MetricsCounter
+{
+public:
+    void add(quint64 n = 1) {m_value.fetchAndAddRelaxed(n);}
+    quint64 value() const {return m_value.loadAcquire();}
+private:
+    QAtomicInteger<quint64> m_value;
+};
+
+class MetricsGauge
+{
+public:
+    void set(qint64 value) {m_value.storeRelease(value);}
+    void add(qint64 delta) {m_value.fetchAndAddRelaxed(delta);}
+    qint64 value() const {return m_value.loadAcquire();}
+private:
+    QAtomicInteger<qint64> m_value;
+};
+
+// Durations in microseconds, counted in power of two buckets: bucket i holds the values
+// below 2^i us, the last one also everything longer
+class MetricsHistogram
+{
+public:
+    static const int Buckets = 32;
+
+    void record(qint64 us);
+    quint64 count() const {return m_count.loadAcquire();}
+    quint64 sum() const {return m_sum.loadAcquire();}
+    quint64 bucket(int i) const {return m_buckets[i].loadAcquire();}
+    static qint64 upperBound(int i) {return qint64(1) << i;}
+
+private:
+    QAtomicInteger<quint64> m_buckets[Buckets];
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_sum;
+};
+
+// Records the lifetime of the scope into a histogram
+class MetricsTimer
+{
+public:
+    explicit MetricsTimer(MetricsHistogram *histogram) : m_histogram(histogram) {m_timer.start();}
+    ~MetricsTimer() {m_histogram->record(m_timer.nsecsElapsed() / 1000);}
+private:
+    MetricsHistogram *m_histogram;
+    QElapsedTimer m_timer;
+};
+
+class NeuroplayMetrics
+{
+public:
+    enum Kind {Counter, Gauge, Histogram};
+
+    // Return the metric of that name, registered by the first call
+    static MetricsCounter *counter(const QString &name, const QString &help = QString());
+    static MetricsGauge *gauge(const QString &name, const QString &help = QString());
+    static MetricsHistogram *histogram(const QString &name, const QString &help = QString());
+    // Name with one label, e.g. name("neuroplay_frames_total", "command", cmd);
+    // the value is escaped as the text format requires, so it may come from the server
+    static QString name(const QString &base, const QString &label, const QString &value);
+
+    typedef struct
+    {
+        QString name;
+        Kind kind;
+        double value;               // counter and gauge value, histogram count
+        double sum;                 // histogram only
+        QVector<quint64> buckets;   // histogram only
+    } Sample;
+
+    // All metrics in registration order
+    static QVector<Sample> snapshot();
+    // In the Prometheus text exposition format
+    static QByteArray text();
+    // Upper bound of the bucket the p-th fraction of the counted values falls into, in us
+    static double percentile(const QVector<quint64> &buckets, double p);
+};
+
+// Samples the metrics periodically for displays: values, per second rates of counters
+// and histogram percentiles over the last interval
+class MetricsMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsMonitor(int intervalMs = 1000, QObject *parent = nullptr);
+
+    double value(const QString &name) const;
+    double rate(const QString &name) const;
+    // Sum of the rates of the counters starting with prefix, e.g. of all labels of a counter
+    double totalRate(const QString &prefix) const;
+    double percentile(const QString &name, double p) const;
+
+signals:
+    void updated();
+
+private slots:
+    void sample();
+
+private:
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    QHash<QString, NeuroplayMetrics::Sample> m_last;
+    QHash<QString, double> m_rates;
+    QHash<QString, QVector<quint64> > m_intervalBuckets;
+};
+
+// Serves NeuroplayMetrics::text() over HTTP on the local host, for scrapers
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+
+    bool listen(quint16 port = DefaultPort);
+    quint16 port() const {return m_server->serverPort();}
+
+    static const quint16 DefaultPort = 9136;
+    // Longer request lines are not waited for, the connection is dropped
+    static const int MaxRequestLine = 8192;
+
+private:
+    QTcpServer *m_server;
+
+    void onNewConnection();
+};
+
+#endif // METRICS_H
@@ -0,0 +1,42 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include "mockserver.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("NeuroplayMockServer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stand-in for the NeuroPlayPro application, serving synthetic EEG");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "WebSocket port.", "port", "1336");
+    QCommandLineOption channelsOption("channels", "Channel count of the devices.", "count", "8");
+    QCommandLineOption rateOption("rate", "Sample rate, Hz.", "hz", "500");
+    QCommandLineOption devicesOption("devices", "Number of devices found by the search.", "count", "1");
+    QCommandLineOption seedOption("seed", "Seed of the synthetic noise and the jitter.", "seed", "1");
+    QCommandLineOption latencyOption("latency", "Response latency, ms.", "ms", "0");
+    QCommandLineOption jitterOption("jitter", "Response latency jitter, +-ms.", "ms", "0");
+    parser.addOptions({portOption, channelsOption, rateOption, devicesOption, seedOption, latencyOption, jitterOption});
+    parser.process(a);
+
+    NeuroplayMock::Config config;
+    config.channels = qMax(1, parser.value(channelsOption).toInt());
+    config.sampleRate = qMax(1, parser.value(rateOption).toInt());
+    config.devices = qMax(0, parser.value(devicesOption).toInt());
+    config.seed = parser.value(seedOption).toUInt();
+
+    MockServer server(config);
+    server.setLatency(parser.value(latencyOption).toInt(), parser.value(jitterOption).toInt());
+    quint16 port = quint16(parser.value(portOption).toUInt());
+    if (!server.listen(port))
+    {
+        qCritical() << "can't listen on port" << port;
+        return 1;
+    }
+    qDebug() << "NeuroplayMock listening on ws://localhost:" << port
+             << config.channels << "ch @" << config.sampleRate << "Hz";
+
+    return a.exec();
+}
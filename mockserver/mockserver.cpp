@@ -0,0 +1,90 @@
+#include "mockserver.h"
+#include <QTimer>
+#include <QHostAddress>
+#include <QDebug>
+
+MockServer::MockServer(const NeuroplayMock::Config &config, QObject *parent) : QObject(parent),
+    m_mock(config),
+    m_random(config.seed),
+    m_latencyMs(0),
+    m_jitterMs(0),
+    m_requests(0)
+{
+    m_server = new QWebSocketServer("NeuroplayMock", QWebSocketServer::NonSecureMode, this);
+    connect(m_server, &QWebSocketServer::newConnection, this, &MockServer::onNewConnection);
+    m_clock.start();
+}
+
+bool MockServer::listen(quint16 port)
+{
+    return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+void MockServer::setLatency(int latency_ms, int jitter_ms)
+{
+    m_latencyMs = qMax(latency_ms, 0);
+    m_jitterMs = qMax(jitter_ms, 0);
+}
+
+void MockServer::onNewConnection()
+{
+    while (m_server->hasPendingConnections())
+    {
+        QWebSocket *socket = m_server->nextPendingConnection();
+        Client client;
+        client.lastDue = 0;
+        m_clients[socket] = client;
+        qDebug() << "client connected" << socket->peerAddress().toString();
+
+        connect(socket, &QWebSocket::textMessageReceived, this, [=](const QString &message)
+        {
+            onMessage(socket, message.toUtf8(), false);
+        });
+        connect(socket, &QWebSocket::binaryMessageReceived, this, [=](const QByteArray &message)
+        {
+            onMessage(socket, message, true);
+        });
+        connect(socket, &QWebSocket::disconnected, this, [=]()
+        {
+            qDebug() << "client disconnected";
+            m_clients.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockServer::onMessage(QWebSocket *socket, const QByteArray &message, bool binary)
+{
+    if (!m_clients.contains(socket))
+        return;
+    Client &client = m_clients[socket];
+    m_requests++;
+
+    // the response reflects the state at the time of the request, like a busy server
+    QByteArray response = m_mock.respond(message, client.session);
+    auto send = [=]()
+    {
+        if (binary)
+            socket->sendBinaryMessage(response);
+        else
+            socket->sendTextMessage(QString::fromUtf8(response));
+    };
+    int ms = delay(client);
+    if (ms <= 0)
+        send();
+    else
+        QTimer::singleShot(ms, socket, send);
+}
+
+int MockServer::delay(Client &client)
+{
+    if (!m_latencyMs && !m_jitterMs)
+        return 0;
+    int jitter = 0;
+    if (m_jitterMs)
+        jitter = std::uniform_int_distribution<int>(-m_jitterMs, m_jitterMs)(m_random);
+    qint64 now = m_clock.elapsed();
+    qint64 due = qMax(now + qMax(m_latencyMs + jitter, 0), client.lastDue);
+    client.lastDue = due;
+    return int(due - now);
+}
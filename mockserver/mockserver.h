@@ -0,0 +1,48 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QtWebSockets/QWebSocketServer>
+#include <QtWebSockets/QWebSocket>
+#include <random>
+#include "neuroplaymock.h"
+
+// WebSocket front end of NeuroplayMock, listening where NeuroPlayPro does (ws://localhost:1336).
+// Every response is delayed by latency +- jitter, keeping the order of responses per connection.
+// Responses are sent in the frame type of the request, text or binary.
+class MockServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MockServer(const NeuroplayMock::Config &config, QObject *parent = nullptr);
+
+    bool listen(quint16 port = 1336);
+    void setLatency(int latency_ms, int jitter_ms);
+
+    quint64 requestCount() const {return m_requests;}
+
+private slots:
+    void onNewConnection();
+
+private:
+    typedef struct
+    {
+        NeuroplayMock::Session session;
+        qint64 lastDue;
+    } Client;
+
+    QWebSocketServer *m_server;
+    NeuroplayMock m_mock;
+    QHash<QWebSocket*, Client> m_clients;
+    QElapsedTimer m_clock;
+    std::mt19937 m_random;
+    int m_latencyMs;
+    int m_jitterMs;
+    quint64 m_requests;
+
+    void onMessage(QWebSocket *socket, const QByteArray &message, bool binary);
+    int delay(Client &client);
+};
+
+#endif // MOCKSERVER_H
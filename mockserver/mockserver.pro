@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Stand-in NeuroPlayPro server for tests and load testing without a device
+#
+#-------------------------------------------------
+
+QT       += core network websockets
+QT       -= gui
+
+TARGET = NeuroplayMockServer
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        main.cpp \
+    mockserver.cpp \
+    neuroplaymock.cpp
+
+HEADERS += \
+    mockserver.h \
+    neuroplaymock.h
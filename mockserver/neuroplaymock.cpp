@@ -0,0 +1,398 @@
+#include "neuroplaymock.h"
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QStringList>
+#include <QtMath>
+
+namespace
+{
+
+// splitmix64, gives reproducible noise for any (seed, channel, index)
+double noise(quint32 seed, int channel, qint64 index)
+{
+    quint64 z = (quint64(seed) << 40) ^ (quint64(channel) << 32) ^ quint64(index);
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return double(z >> 11) / double(1ULL << 53) * 2.0 - 1.0;
+}
+
+const char *const helpCommands[] = {
+    "help", "version", "listdevices", "startsearch", "startdevice", "stopdevice", "currentdeviceinfo",
+    "getfavoritedevicename", "makefavorite", "getfilters", "setLPF", "setHPF", "setBSF", "setdefaultfilters",
+    "getdatastoragetime", "setdatastoragetime", "enabledatagrabmode", "disabledatagrabmode",
+    "grabrawdata", "graboriginaldata", "filtereddata", "rawdata", "spectrumfrequencies", "lastSpectrum",
+    "rhythms", "rhythmsHistory", "meditation", "meditationHistory", "concentration", "concentrationHistory",
+    "BCI", "startrecord", "stoprecord"
+};
+
+const int SpectrumBins = 50;
+
+} // namespace
+
+NeuroplayMock::NeuroplayMock(const Config &config) :
+    m_config(config),
+    m_startTime(0),
+    m_currentDevice(-1),
+    m_channels(config.channels),
+    m_grabMode(false),
+    m_recording(false),
+    m_recordStart(0),
+    m_LPF(30), m_HPF(1), m_BSF(50),
+    m_storageTime(5)
+{
+    m_clock.start();
+    m_favorite = deviceName(0);
+}
+
+QByteArray NeuroplayMock::respond(const QByteArray &request, Session &session)
+{
+    QByteArray text = request.trimmed();
+    QJsonObject req;
+    QString cmd;
+    if (text.startsWith('{'))
+    {
+        req = QJsonDocument::fromJson(text).object();
+        cmd = req["command"].toString();
+    }
+    else
+    {
+        cmd = QString::fromUtf8(text);
+    }
+    cmd = cmd.toLower();
+
+    // sample frames are written directly, they are the bulk of the traffic
+    if (isStarted() && m_grabMode && cmd == "grabrawdata")
+        return grabFrame("grabfiltereddata", session.filteredPos, false);
+    if (isStarted() && m_grabMode && cmd == "graboriginaldata")
+        return grabFrame("grabrawdata", session.rawPos, true);
+
+    QJsonObject resp = handle(cmd, req, session);
+    if (!resp.contains("command"))
+        resp["command"] = cmd;
+    if (!resp.contains("result"))
+        resp["result"] = true;
+    return QJsonDocument(resp).toJson(QJsonDocument::Compact);
+}
+
+double NeuroplayMock::sample(int channel, qint64 index, bool raw) const
+{
+    double t = double(index) / m_config.sampleRate;
+    double value = 20.0 * qSin(2 * M_PI * 10.0 * t + channel)
+                 + 6.0 * qSin(2 * M_PI * 21.0 * t + 2.0 * channel)
+                 + 10.0 * qSin(2 * M_PI * 1.3 * t + 0.5 * channel)
+                 + 5.0 * noise(m_config.seed, channel, index);
+    if (raw)
+        value += 20000.0 + 1000.0 * channel + 1500.0 * qSin(2 * M_PI * 0.05 * t);
+    return value;
+}
+
+QJsonObject NeuroplayMock::handle(const QString &cmd, const QJsonObject &req, Session &session)
+{
+    QJsonObject resp;
+    if (cmd == "help")
+    {
+        QJsonArray commands;
+        for (const char *c: helpCommands)
+            commands.append(QJsonObject{{"command", c}, {"description", ""}});
+        resp["commands"] = commands;
+    }
+    else if (cmd == "version")
+    {
+        resp["version"] = "mock-1.0";
+    }
+    else if (cmd == "listdevices")
+    {
+        QJsonArray devices;
+        for (int i=0; i<m_config.devices; i++)
+            devices.append(deviceInfo(i));
+        resp["devices"] = devices;
+    }
+    else if (cmd == "startsearch")
+    {
+    }
+    else if (cmd == "enabledatagrabmode" || cmd == "disabledatagrabmode")
+    {
+        m_grabMode = (cmd == "enabledatagrabmode");
+    }
+    else if (cmd == "startdevice")
+    {
+        QString sn = req["sn"].toString();
+        int index = -1;
+        for (int i=0; i<m_config.devices; i++)
+            if (deviceInfo(i)["serialNumber"].toString() == sn)
+                index = i;
+        if (index < 0 && m_config.devices > 0 && sn.isEmpty())
+            index = 0;
+        if (index < 0)
+        {
+            resp["result"] = false;
+            resp["error"] = "device not found";
+        }
+        else
+        {
+            m_currentDevice = index;
+            m_channels = qBound(1, req["channels"].toInt(m_config.channels), m_config.channels);
+            m_startTime = m_clock.elapsed();
+            session = Session();
+        }
+    }
+    else if (cmd == "stopdevice")
+    {
+        m_currentDevice = -1;
+        m_recording = false;
+    }
+    else if (cmd == "currentdeviceinfo")
+    {
+        resp["result"] = isStarted();
+        if (isStarted())
+        {
+            QJsonObject info = deviceInfo(m_currentDevice);
+            info["channels"] = m_channels;
+            resp["device"] = info;
+        }
+    }
+    else if (cmd == "getfavoritedevicename")
+    {
+        resp["device"] = m_favorite;
+    }
+    else if (cmd == "makefavorite")
+    {
+        m_favorite = req["value"].toString();
+    }
+    else if (cmd == "getfilters" || cmd == "setdefaultfilters")
+    {
+        if (cmd == "setdefaultfilters")
+        {
+            m_LPF = 30;
+            m_HPF = 1;
+            m_BSF = 50;
+        }
+        resp["LPF"] = m_LPF;
+        resp["HPF"] = m_HPF;
+        resp["BSF"] = m_BSF;
+    }
+    else if (cmd == "setlpf" || cmd == "sethpf" || cmd == "setbsf")
+    {
+        double value = req["value"].toDouble();
+        if (cmd == "setlpf")
+            m_LPF = value;
+        else if (cmd == "sethpf")
+            m_HPF = value;
+        else
+            m_BSF = value;
+    }
+    else if (cmd == "getdatastoragetime" || cmd == "setdatastoragetime")
+    {
+        if (cmd == "setdatastoragetime")
+            m_storageTime = qMax(1, req["value"].toVariant().toInt());
+        resp["storagetime"] = m_storageTime;
+    }
+    else if (!isStarted())
+    {
+        resp["result"] = false;
+        resp["error"] = "device is not started";
+    }
+    else if (cmd == "grabrawdata" || cmd == "graboriginaldata")
+    {
+        resp["command"] = (cmd == "grabrawdata")? "grabfiltereddata": "grabrawdata";
+        resp["result"] = false;
+        resp["error"] = "data grab mode is disabled";
+    }
+    else if (cmd == "filtereddata" || cmd == "rawdata")
+    {
+        bool raw = (cmd == "rawdata");
+        qint64 to = currentSample();
+        QJsonArray data;
+        for (int j=0; j<m_channels; j++)
+        {
+            QJsonArray ch;
+            for (qint64 i=qMax(qint64(0), to - m_config.sampleRate); i<to; i++)
+                ch.append(sample(j, i, raw));
+            data.append(ch);
+        }
+        resp["data"] = data;
+    }
+    else if (cmd == "spectrumfrequencies")
+    {
+        QJsonArray freq;
+        for (int i=0; i<SpectrumBins; i++)
+            freq.append(i + 1);
+        resp["spectrum"] = freq;
+    }
+    else if (cmd == "lastspectrum")
+    {
+        double t = elapsed() / 1000.0;
+        QJsonArray spectrum;
+        for (int j=0; j<m_channels; j++)
+        {
+            QJsonArray ch;
+            for (int i=0; i<SpectrumBins; i++)
+            {
+                double f = i + 1;
+                double value = -20.0 + 15.0 * qExp(-(f - 10) * (f - 10) / 4.0)
+                             + 6.0 * qExp(-(f - 21) * (f - 21) / 9.0) - 0.2 * f
+                             + 0.5 * qSin(t + j + f);
+                ch.append(value);
+            }
+            spectrum.append(ch);
+        }
+        resp["spectrum"] = spectrum;
+    }
+    else if (cmd == "rhythms")
+    {
+        resp["rhythms"] = rhythms(elapsed() / RhythmsPeriodMs);
+    }
+    else if (cmd == "rhythmshistory")
+    {
+        qint64 last = elapsed() / RhythmsPeriodMs;
+        qint64 first = qMax(session.rhythmsPos < 0? last: session.rhythmsPos,
+                            last - m_storageTime * 1000 / RhythmsPeriodMs);
+        session.rhythmsPos = last;
+        QJsonArray history;
+        for (qint64 e=first; e<last; e++)
+            history.append(rhythms(e));
+        resp["history"] = history;
+    }
+    else if (cmd == "meditation" || cmd == "concentration" || cmd == "bci")
+    {
+        qint64 entry = elapsed() / IndexPeriodMs;
+        if (cmd != "concentration")
+            resp["meditation"] = indexValue(entry, 0);
+        if (cmd != "meditation")
+            resp["concentration"] = indexValue(entry, 1.7);
+    }
+    else if (cmd == "meditationhistory" || cmd == "concentrationhistory")
+    {
+        bool meditation = (cmd == "meditationhistory");
+        qint64 &pos = meditation? session.meditationPos: session.concentrationPos;
+        qint64 last = elapsed() / IndexPeriodMs;
+        qint64 first = qMax(pos < 0? last: pos, last - m_storageTime * 1000 / IndexPeriodMs);
+        pos = last;
+        QJsonArray history;
+        for (qint64 e=first; e<last; e++)
+            history.append(QJsonObject{{"v", indexValue(e, meditation? 0: 1.7)}, {"t", double(e * IndexPeriodMs)}});
+        resp["history"] = history;
+    }
+    else if (cmd == "startrecord")
+    {
+        m_recording = true;
+        m_recordStart = currentSample();
+    }
+    else if (cmd == "stoprecord")
+    {
+        if (!m_recording)
+        {
+            resp["result"] = false;
+            resp["error"] = "not recording";
+        }
+        else
+        {
+            // payload sizes match a 16-bit recording of the session, the content is synthetic
+            m_recording = false;
+            qint64 to = currentSample();
+            QByteArray edf("0       ");
+            edf.reserve(int(256 + (to - m_recordStart) * m_channels * 2));
+            for (qint64 i=m_recordStart; i<to; i++)
+            {
+                for (int j=0; j<m_channels; j++)
+                {
+                    qint16 v = qint16(qBound(-32768.0, sample(j, i, false) * 10, 32767.0));
+                    edf.append(char(v & 0xff));
+                    edf.append(char((v >> 8) & 0xff));
+                }
+            }
+            QByteArray npd = QString("mock npd, %1 samples").arg(to - m_recordStart).toUtf8();
+            resp["files"] = QJsonArray{
+                QJsonObject{{"type", "edf"}, {"data", QString::fromLatin1(edf.toBase64())}},
+                QJsonObject{{"type", "npd"}, {"data", QString::fromLatin1(npd.toBase64())}}
+            };
+        }
+    }
+    else
+    {
+        resp["result"] = false;
+        resp["error"] = "unknown command";
+    }
+    return resp;
+}
+
+QJsonObject NeuroplayMock::deviceInfo(int index) const
+{
+    QJsonArray modes;
+    modes.append(QJsonObject{{"channels", m_config.channels}, {"frequency", m_config.sampleRate}});
+    if (m_config.channels > 4)
+        modes.append(QJsonObject{{"channels", 4}, {"frequency", m_config.sampleRate}});
+    return QJsonObject{
+        {"name", deviceName(index)},
+        {"model", "NeuroplayMock"},
+        {"serialNumber", QString("MOCK%1").arg(index + 1, 4, 10, QChar('0'))},
+        {"maxChannels", m_config.channels},
+        {"preferredChannelCount", m_config.channels},
+        {"channelModes", modes}
+    };
+}
+
+QString NeuroplayMock::deviceName(int index) const
+{
+    return QString("NeuroplayMock-%1").arg(index + 1);
+}
+
+qint64 NeuroplayMock::oldestSample() const
+{
+    return qMax(qint64(0), currentSample() - qint64(m_storageTime) * m_config.sampleRate);
+}
+
+QByteArray NeuroplayMock::grabFrame(const char *command, qint64 &pos, bool raw)
+{
+    qint64 now = currentSample();
+    qint64 from = (pos < 0)? now: qMax(pos, oldestSample());
+    pos = now;
+    return dataFrame(command, from, now, raw);
+}
+
+QByteArray NeuroplayMock::dataFrame(const char *command, qint64 from, qint64 to, bool raw) const
+{
+    QByteArray frame;
+    frame.reserve(int(64 + (to - from) * m_channels * 10));
+    frame += "{\"command\":\"";
+    frame += command;
+    frame += "\",\"result\":true,\"data\":[";
+    for (int j=0; j<m_channels; j++)
+    {
+        frame += (j? ",[": "[");
+        for (qint64 i=from; i<to; i++)
+        {
+            if (i > from)
+                frame += ',';
+            frame += QByteArray::number(sample(j, i, raw), 'f', 3);
+        }
+        frame += ']';
+    }
+    frame += "]}";
+    return frame;
+}
+
+QJsonArray NeuroplayMock::rhythms(qint64 entry) const
+{
+    double t = entry * RhythmsPeriodMs / 1000.0;
+    QJsonArray arr;
+    for (int j=0; j<m_channels; j++)
+    {
+        arr.append(QJsonObject{
+            {"delta", 30 + 5 * qSin(0.3 * t + j)},
+            {"theta", 20 + 4 * qSin(0.5 * t + j)},
+            {"alpha", 35 + 10 * qSin(0.2 * t + j)},
+            {"beta", 10 + 3 * qSin(0.7 * t + j)},
+            {"gamma", 5 + 1 * qSin(1.1 * t + j)},
+            {"t", double(entry * RhythmsPeriodMs)}
+        });
+    }
+    return arr;
+}
+
+double NeuroplayMock::indexValue(qint64 entry, double phase) const
+{
+    return 50 + 30 * qSin(2 * M_PI * entry / 60.0 + phase);
+}
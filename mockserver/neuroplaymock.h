@@ -0,0 +1,75 @@
+#ifndef NEUROPLAYMOCK_H
+#define NEUROPLAYMOCK_H
+
+#include <QByteArray>
+#include <QString>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QElapsedTimer>
+
+// Protocol logic of a stand-in NeuroPlayPro application.
+// Answers the commands used by the SDK with synthetic but deterministic EEG:
+// the value of a sample depends only on its channel, index and the seed,
+// so the same request sequence always returns the same data.
+class NeuroplayMock
+{
+public:
+    class Config
+    {
+    public:
+        Config() : channels(8), sampleRate(500), devices(1), seed(1) {}
+        int channels;
+        int sampleRate;
+        int devices;
+        quint32 seed;
+    };
+
+    // Per connection read positions of the grab streams
+    class Session
+    {
+    public:
+        Session() : filteredPos(-1), rawPos(-1), rhythmsPos(-1), meditationPos(-1), concentrationPos(-1) {}
+        qint64 filteredPos, rawPos;
+        qint64 rhythmsPos, meditationPos, concentrationPos;
+    };
+
+    explicit NeuroplayMock(const Config &config = Config());
+
+    const Config &config() const {return m_config;}
+
+    // Takes a plain text command or a JSON command object, returns the response frame
+    QByteArray respond(const QByteArray &request, Session &session);
+
+    // Synthetic signal, in microvolts for filtered data
+    double sample(int channel, qint64 index, bool raw) const;
+
+    static const int RhythmsPeriodMs = 100;
+    static const int IndexPeriodMs = 1000;
+
+private:
+    Config m_config;
+    QElapsedTimer m_clock;
+    qint64 m_startTime;
+    int m_currentDevice;
+    int m_channels;
+    bool m_grabMode;
+    bool m_recording;
+    qint64 m_recordStart;
+    double m_LPF, m_HPF, m_BSF;
+    int m_storageTime;
+    QString m_favorite;
+
+    QJsonObject handle(const QString &cmd, const QJsonObject &req, Session &session);
+    QJsonObject deviceInfo(int index) const;
+    QString deviceName(int index) const;
+    bool isStarted() const {return m_currentDevice >= 0;}
+    qint64 elapsed() const {return m_clock.elapsed() - m_startTime;}
+    qint64 currentSample() const {return elapsed() * m_config.sampleRate / 1000;}
+    qint64 oldestSample() const;
+    QByteArray grabFrame(const char *command, qint64 &pos, bool raw);
+    QByteArray dataFrame(const char *command, qint64 from, qint64 to, bool raw) const;
+    QJsonArray rhythms(qint64 entry) const;
+    double indexValue(qint64 entry, double phase) const;
+};
+
+#endif // NEUROPLAYMOCK_H
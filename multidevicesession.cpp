@@ -0,0 +1,329 @@
+#include "multidevicesession.h"
+#include "neuroplaylog.h"
+
+MultiDeviceSession::MultiDeviceSession(QObject *parent) : QObject(parent),
+    m_running(false),
+    m_mergedRate(0),
+    m_mergedStartUs(0),
+    m_mergedCount(0)
+{
+    m_clock.start();
+}
+
+MultiDeviceSession::~MultiDeviceSession()
+{
+    stop();
+}
+
+int MultiDeviceSession::addDevice(Transport *transport, const QString &serialNumber, int channelMode, bool workerThread)
+{
+    Member m;
+    m.pro = new NeuroplayPro(this);
+    if (workerThread)
+        m.pro->enableWorkerThread();
+    m.pro->setTransport(transport);
+    m.serialNumber = serialNumber;
+    m.channelMode = channelMode;
+    m.startRequested = false;
+    m.device = nullptr;
+    m.stagedBase = 0;
+    m.total = 0;
+    m.rate = 0;
+    m.startUs = 0;
+    m.stats.samples = 0;
+    m.stats.blocks = 0;
+    m.stats.samplesPerSecond = 0;
+    m.stats.lagMs = 0;
+    m.statsSamples = 0;
+    m.statsStartUs = elapsedUs();
+
+    int index = m_members.size();
+    m_members << m;
+    connect(m.pro, &NeuroplayPro::devicesListed, this, [=]()
+    {
+        startWantedDevice(index);
+    });
+    connect(m.pro, &NeuroplayPro::deviceStartFailed, this, [=]()
+    {
+        onDeviceStartFailed(index);
+    });
+    connect(m.pro, &NeuroplayPro::deviceReady, this, [=](NeuroplayDevice *device)
+    {
+        onDeviceReady(index, device);
+    });
+    if (m_running)
+        m.pro->open();
+    resetMerge();
+    return index;
+}
+
+int MultiDeviceSession::addDevice(const QUrl &url, const QString &serialNumber, int channelMode, bool workerThread)
+{
+    return addDevice(new WebSocketTransport(url), serialNumber, channelMode, workerThread);
+}
+
+int MultiDeviceSession::mergedChannelOffset(int index) const
+{
+    if (!m_mergedRate)
+        return -1;
+    int offset = 0;
+    for (int d=0; d<index; d++)
+        offset += m_members[d].staged.channels();
+    return offset;
+}
+
+NeuroplayDevice::ChannelsData MultiDeviceSession::readMergedData(qint64 *firstTimeUs)
+{
+    if (firstTimeUs)
+        *firstTimeUs = m_mergedRate? qint64(m_mergedStartUs + (m_mergedCount - m_merged.size()) * 1e6 / m_mergedRate): 0;
+    return m_merged.read();
+}
+
+void MultiDeviceSession::start()
+{
+    m_running = true;
+    for (int i=0; i<m_members.size(); i++)
+    {
+        Member &m = m_members[i];
+        if (!m.pro->isConnected())
+        {
+            m.pro->open();
+        }
+        else if (m.device)
+        {
+            startDevice(m, m.device);
+        }
+        else
+        {
+            startWantedDevice(i);
+            if (!m.startRequested)
+                m.pro->send(QString("startsearch"));
+        }
+    }
+}
+
+void MultiDeviceSession::stop()
+{
+    m_running = false;
+    for (Member &m: m_members)
+    {
+        if (m.device)
+            m.device->stop();
+        m.startRequested = false;
+    }
+    resetMerge();
+}
+
+void MultiDeviceSession::startDevice(Member &m, NeuroplayDevice *device)
+{
+    m.startRequested = true;
+    if (m.channelMode > 0)
+        device->start(m.channelMode);
+    else
+        device->start();
+}
+
+void MultiDeviceSession::startWantedDevice(int index)
+{
+    Member &m = m_members[index];
+    if (!m_running || m.device || m.startRequested)
+        return;
+    // devices the server already knows are not announced by deviceConnected() again
+    for (int i=0; i<m.pro->deviceCount(); i++)
+    {
+        NeuroplayDevice *device = m.pro->device(i);
+        if (device->isConnected() && (m.serialNumber.isEmpty() || device->serialNumber() == m.serialNumber))
+        {
+            startDevice(m, device);
+            return;
+        }
+    }
+}
+
+void MultiDeviceSession::onDeviceStartFailed(int index)
+{
+    Member &m = m_members[index];
+    if (!m.startRequested)
+        return;
+    qCDebug(lcNeuroplay) << "session: device" << index << "did not start, searching again";
+    m.startRequested = false;
+    if (m_running)
+        m.pro->send(QString("startsearch"));
+}
+
+void MultiDeviceSession::onDeviceReady(int index, NeuroplayDevice *device)
+{
+    Member &m = m_members[index];
+    if (!m_running)
+        return;
+    if (!m.serialNumber.isEmpty() && device->serialNumber() != m.serialNumber)
+    {
+        // the server runs a headset that is not ours, maybe for another client: leave it running
+        // and start ours from the device list, searching for it first if it is not known yet
+        qCDebug(lcNeuroplay) << "session: device" << index << "skips" << device->serialNumber();
+        startWantedDevice(index);
+        if (!m.startRequested)
+            m.pro->send(QString("startsearch"));
+        return;
+    }
+
+    if (m.device)
+        disconnect(m.device, &NeuroplayDevice::filteredSamplesAppended, this, nullptr);
+    m.device = device;
+    m.startRequested = false;
+    m.total = 0;
+    m.rate = 0;
+    m.staged.clear();
+    connect(device, &NeuroplayDevice::filteredSamplesAppended, this, [=](int count)
+    {
+        onSamples(index, count);
+    });
+    device->grabFilteredData();
+    resetMerge();
+    emit deviceReady(index);
+}
+
+void MultiDeviceSession::onSamples(int index, int count)
+{
+    Member &m = m_members[index];
+    if (!m_running || !m.device)
+        return;
+    const SampleRingBuffer &src = m.device->filteredDataBuffer();
+    count = qMin(count, src.size());
+    if (count <= 0)
+        return;
+    qint64 nowUs = elapsedUs();
+
+    int rate = m.device->sampleRate();
+    if (src.channels() != m.staged.channels() || rate != m.rate)
+    {
+        m.rate = rate;
+        m.staged.reset(src.channels(), rate * NeuroplayDevice::HistorySeconds);
+        m.stagedBase = 0;
+        m.total = 0;
+        resetMerge();
+    }
+
+    // the newest count samples of the device history
+    count = qMin(count, m.staged.capacity());
+    int skip = src.size() - count;
+    for (int j=0; j<src.channels(); j++)
+    {
+        SampleRingBuffer::Span s = src.span(j);
+        SampleRingBuffer::Writer w = m.staged.writer(j);
+        for (int i=skip; i<s.size(); i++)
+            w.put(s[i]);
+    }
+    // samples the staging overwrites are lost for the merge
+    m.stagedBase += qMax(m.staged.size() + count - m.staged.capacity(), 0);
+    m.staged.commit(count);
+    m.total += count;
+
+    // delays only make a block late, so the earliest implied start is the best one
+    double startUs = nowUs - m.total * 1e6 / m.rate;
+    if (m.total == count || startUs < m.startUs)
+        m.startUs = startUs;
+
+    m.stats.samples += count;
+    m.stats.blocks++;
+    m.stats.lagMs = (nowUs - (m.startUs + m.total * 1e6 / m.rate)) / 1000;
+    if (nowUs - m.statsStartUs >= StatsIntervalMs * 1000)
+    {
+        m.stats.samplesPerSecond = (m.stats.samples - m.statsSamples) * 1e6 / (nowUs - m.statsStartUs);
+        m.statsSamples = m.stats.samples;
+        m.statsStartUs = nowUs;
+    }
+
+    merge();
+}
+
+bool MultiDeviceSession::isMergeable() const
+{
+    if (!m_running || m_members.isEmpty())
+        return false;
+    for (const Member &m: m_members)
+    {
+        if (!m.device || !m.total)
+            return false;
+    }
+    return true;
+}
+
+void MultiDeviceSession::resetMerge()
+{
+    m_mergedRate = 0;
+    m_mergedCount = 0;
+    m_merged.clear();
+}
+
+void MultiDeviceSession::merge()
+{
+    if (!isMergeable())
+        return;
+
+    int devices = m_members.size();
+    if (!m_mergedRate)
+    {
+        int channels = 0;
+        m_mergedStartUs = m_members[0].startUs;
+        for (const Member &m: m_members)
+        {
+            channels += m.staged.channels();
+            m_mergedStartUs = qMax(m_mergedStartUs, m.startUs);
+        }
+        m_mergedRate = m_members[0].rate;
+        m_merged.reset(channels, m_mergedRate * NeuroplayDevice::HistorySeconds);
+        qCDebug(lcNeuroplay) << "session: merging" << devices << "devices," << channels << "channels at" << m_mergedRate << "Hz";
+    }
+
+    // the nearest staged sample of every device for each merged sample all of them have
+    int n = 0;
+    m_mergeIndex.resize(0);
+    while (n < m_merged.capacity())
+    {
+        double timeUs = m_mergedStartUs + (m_mergedCount + n) * 1e6 / m_mergedRate;
+        int d = 0;
+        for (; d<devices; d++)
+        {
+            const Member &m = m_members[d];
+            qint64 k = qRound64((timeUs - m.startUs) * m.rate / 1e6);
+            if (k >= m.total)
+                break;
+            m_mergeIndex << int(qBound(qint64(0), k - m.stagedBase, qint64(m.staged.size() - 1)));
+        }
+        if (d < devices)
+        {
+            m_mergeIndex.resize(n * devices);
+            break;
+        }
+        n++;
+    }
+    if (!n)
+        return;
+
+    int channel = 0;
+    for (int d=0; d<devices; d++)
+    {
+        const SampleRingBuffer &staged = m_members[d].staged;
+        for (int j=0; j<staged.channels(); j++)
+        {
+            SampleRingBuffer::Span s = staged.span(j);
+            SampleRingBuffer::Writer w = m_merged.writer(channel++);
+            for (int i=0; i<n; i++)
+                w.put(s[m_mergeIndex[i * devices + d]]);
+        }
+    }
+    m_merged.commit(n);
+    m_mergedCount += n;
+
+    // staged samples before the next merged one are not needed anymore
+    double nextUs = m_mergedStartUs + m_mergedCount * 1e6 / m_mergedRate;
+    for (Member &m: m_members)
+    {
+        qint64 k = qRound64((nextUs - m.startUs) * m.rate / 1e6);
+        int used = int(qBound(qint64(0), k - m.stagedBase, qint64(m.staged.size())));
+        m.staged.consume(used);
+        m.stagedBase += used;
+    }
+    emit mergedSamplesReady(n);
+}
@@ -0,0 +1,110 @@
+#ifndef MULTIDEVICESESSION_H
+#define MULTIDEVICESESSION_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include "neuroplaypro.h"
+
+// Runs several headsets at once. NeuroPlayPro drives one device per server, so every device gets
+// a NeuroplayPro of its own: its own transport (a server instance per headset), optional worker
+// thread, grab scheduler and buffers. The filtered samples of all started devices are also merged
+// into one stream of all their channels, aligned in time:
+//  - a device's sample k is at start + k / sampleRate, where start is the earliest arrival time
+//    minus the duration of the samples received until then (network delays only make it later);
+//  - the merged stream runs at the rate of the first device, other devices are resampled to it
+//    by taking their nearest sample;
+//  - it starts when the last device starts, and a merged sample is produced once all devices have it.
+class MultiDeviceSession : public QObject
+{
+    Q_OBJECT
+public:
+    typedef struct
+    {
+        quint64 samples;            // filtered samples received
+        quint64 blocks;
+        double samplesPerSecond;    // over the last StatsIntervalMs
+        double lagMs;               // of the newest block behind its nominal time
+    } DeviceStats;
+
+    explicit MultiDeviceSession(QObject *parent = nullptr);
+    virtual ~MultiDeviceSession();
+
+    // Adds a device reached through transport (taking ownership), e.g. a WebSocketTransport to
+    // another server instance. An empty serialNumber takes the device the server finds first,
+    // channelMode 0 the device's default mode. Returns the index of the device in the session.
+    int addDevice(Transport *transport, const QString &serialNumber = QString(), int channelMode = 0,
+                  bool workerThread = true);
+    int addDevice(const QUrl &url, const QString &serialNumber = QString(), int channelMode = 0,
+                  bool workerThread = true);
+
+    int deviceCount() const {return m_members.size();}
+    NeuroplayPro *connection(int index) const {return m_members[index].pro;}
+    // Null until the device has been found and started
+    NeuroplayDevice *device(int index) const {return m_members[index].device;}
+    DeviceStats stats(int index) const {return m_members[index].stats;}
+    bool isRunning() const {return m_running;}
+
+    // Merged samples, channels of device 0 first; the stream is restarted when a device restarts
+    const SampleRingBuffer &mergedBuffer() const {return m_merged;}
+    int mergedSampleRate() const {return m_mergedRate;}
+    // First merged channel of a device, -1 before the merge started
+    int mergedChannelOffset(int index) const;
+    // Copies and removes the merged samples; firstTimeUs gets the session time of the first one
+    NeuroplayDevice::ChannelsData readMergedData(qint64 *firstTimeUs = nullptr);
+
+    // Session clock, the time base of the merged stream
+    qint64 elapsedUs() const {return m_clock.nsecsElapsed() / 1000;}
+
+    static const int StatsIntervalMs = 1000;
+
+public slots:
+    // Connects and starts all devices; stop() stops the devices and keeps the connections
+    void start();
+    void stop();
+
+signals:
+    void deviceReady(int index);
+    void mergedSamplesReady(int count);
+
+private:
+    typedef struct
+    {
+        NeuroplayPro *pro;
+        QString serialNumber;
+        int channelMode;
+        bool startRequested;
+        NeuroplayDevice *device;
+
+        SampleRingBuffer staged;    // received, not merged yet
+        qint64 stagedBase;          // index of the oldest staged sample in the device's stream
+        qint64 total;               // samples received since the device (re)started
+        int rate;
+        double startUs;             // session time of sample 0
+
+        DeviceStats stats;
+        quint64 statsSamples;       // stats.samples at statsStartUs
+        qint64 statsStartUs;
+    } Member;
+
+    QVector<Member> m_members;
+    bool m_running;
+    QElapsedTimer m_clock;
+
+    SampleRingBuffer m_merged;
+    int m_mergedRate;
+    double m_mergedStartUs;
+    qint64 m_mergedCount;           // merged samples produced
+    QVector<int> m_mergeIndex;      // staged positions of the samples to merge, per sample and device
+
+    void startDevice(Member &m, NeuroplayDevice *device);
+    // Starts the device of the serial number (or the first one) if the server has listed it
+    void startWantedDevice(int index);
+    void onDeviceStartFailed(int index);
+    void onDeviceReady(int index, NeuroplayDevice *device);
+    void onSamples(int index, int count);
+    bool isMergeable() const;
+    void resetMerge();
+    void merge();
+};
+
+#endif // MULTIDEVICESESSION_H
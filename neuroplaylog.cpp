@@ -0,0 +1,14 @@
+#include "neuroplaylog.h"
+#include <QDateTime>
+
+Q_LOGGING_CATEGORY(lcNeuroplay, "neuroplay", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcNeuroplayRx, "neuroplay.rx", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcNeuroplayTx, "neuroplay.tx", QtWarningMsg)
+
+bool NeuroplayLogLimiter::allow()
+{
+    qint64 second = QDateTime::currentMSecsSinceEpoch() / 1000;
+    if (m_second.fetchAndStoreRelaxed(second) != second)
+        m_count.fetchAndStoreRelaxed(0);
+    return m_count.fetchAndAddRelaxed(1) < MessagesPerSecond;
+}
@@ -0,0 +1,39 @@
+#ifndef NEUROPLAYLOG_H
+#define NEUROPLAYLOG_H
+
+#include <QLoggingCategory>
+#include <QAtomicInteger>
+
+// Logging categories of the SDK, all silent by default. Enable with e.g.
+//   QT_LOGGING_RULES="neuroplay.*.debug=true"
+Q_DECLARE_LOGGING_CATEGORY(lcNeuroplay)     // "neuroplay": connection and device life cycle
+Q_DECLARE_LOGGING_CATEGORY(lcNeuroplayRx)   // "neuroplay.rx": every received response
+Q_DECLARE_LOGGING_CATEGORY(lcNeuroplayTx)   // "neuroplay.tx": every sent command
+
+// Per call site limit for the hot path traces
+class NeuroplayLogLimiter
+{
+public:
+    static const int MessagesPerSecond = 20;
+    bool allow();
+private:
+    QAtomicInteger<qint64> m_second;
+    QAtomicInt m_count;
+};
+
+// NP_TRACE(category) << ...; is used on per-frame paths.
+// It costs one flag check while the category is disabled, prints at most
+// MessagesPerSecond lines per call site, and is compiled out of release builds
+// unless NEUROPLAY_TRACE is defined.
+#if defined(QT_NO_DEBUG) && !defined(NEUROPLAY_TRACE)
+#  define NP_TRACE(category) \
+    while (false) QMessageLogger().noDebug()
+#else
+#  define NP_TRACE(category) \
+    for (bool np_enabled = category().isDebugEnabled() && \
+             []() -> NeuroplayLogLimiter & {static NeuroplayLogLimiter limiter; return limiter;}().allow(); \
+         np_enabled; np_enabled = false) \
+        QMessageLogger(QT_MESSAGELOG_FILE, QT_MESSAGELOG_LINE, QT_MESSAGELOG_FUNC, category().categoryName()).debug()
+#endif
+
+#endif // NEUROPLAYLOG_H
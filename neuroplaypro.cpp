@@ -1,13 +1,25 @@
 #include "neuroplaypro.h"
+#include "grabdecoder.h"
+#include "base64decoder.h"
+#include "commandwriter.h"
+#include "neuroplaylog.h"
+#include <QMetaMethod>
 
 // ===================== NeuroplayDevice ====================== //
 
 NeuroplayDevice::NeuroplayDevice(const QJsonObject &json) :
     m_id(-1),
+    m_startedChannels(0),
     m_isConnected(false),
     m_isStarted(false),
     m_grabFilteredData(false), m_grabRawData(false), m_grabRhythms(false), m_grabMeditation(false), m_grabConcentration(false),
-    m_meditation(0), m_concentration(0)
+    m_computeRhythms(false), m_localFiltering(false),
+    m_meditation(0), m_concentration(0),
+    m_spectrumPending(false), m_rhythmsPending(false),
+    m_adaptiveGrab(false), m_serverStorageTime(0), m_requestedStorageTime(0), m_restoreStorageTime(0),
+    m_bandPowerWindow(512), m_bandPowerStepMs(100),
+    m_recorder(nullptr), m_recorderThread(nullptr),
+    m_recordRaw(false), m_recorderOpened(false), m_recordRange(0)
 {
     m_name = json["name"].toString();
     m_model = json["model"].toString();
@@ -22,10 +34,19 @@ NeuroplayDevice::NeuroplayDevice(const QJsonObject &json) :
         int frequency = o["frequency"].toInt();
         m_channelModes << QPair<int, int>(channels, frequency);
     }
-    m_grabTimer = new QTimer(this);
-    connect(m_grabTimer, &QTimer::timeout, this, &NeuroplayDevice::grabRequest);
+    m_filteredDataBuffer.reset(m_maxChannels, historyCapacity());
+    m_rawDataBuffer.reset(m_maxChannels, historyCapacity());
+    m_grabScheduler = new GrabScheduler(this);
+    m_grabScheduler->setInterval(m_grabIntervalMs);
+    connect(m_grabScheduler, &GrabScheduler::poll, this, &NeuroplayDevice::grabRequest);
+}
 
-    connect(this, &QObject::destroyed, this, &NeuroplayDevice::stop);
+NeuroplayDevice::~NeuroplayDevice()
+{
+    // members are still alive here, unlike in a handler of destroyed();
+    // nothing is sent, the server may already be gone
+    m_grabScheduler->stop();
+    closeRecorder();
 }
 
 QStringList NeuroplayDevice::channelModes() const
@@ -38,7 +59,7 @@ QStringList NeuroplayDevice::channelModes() const
 
 void NeuroplayDevice::makeFavorite()
 {
-    request({{"command", "makefavorite"}, {"value", m_name}});
+    request(CommandWriter("makefavorite").add("value", m_name).toUtf8());
     request("getfavoritedevicename");
 }
 
@@ -54,6 +75,88 @@ void NeuroplayDevice::grabRawData(bool enable)
     switchGrabMode();
 }
 
+void NeuroplayDevice::computeRhythms(bool enable, int windowSize, int stepMs)
+{
+    m_computeRhythms = enable;
+    m_bandPowerWindow = windowSize;
+    m_bandPowerStepMs = stepMs;
+    // the engine is set up for the actual channel count with the first samples
+    m_bandPower.reset(0, 0);
+    switchGrabMode();
+}
+
+void NeuroplayDevice::setLocalFilters(double LPF, double HPF, double BSF)
+{
+    m_localFilter.setFilters(LPF, HPF, BSF);
+    m_localFiltering = true;
+    switchGrabMode();
+}
+
+void NeuroplayDevice::disableLocalFilters()
+{
+    m_localFiltering = false;
+    switchGrabMode();
+}
+
+int NeuroplayDevice::addFilterBank(double LPF, double HPF, double BSF)
+{
+    FilterBank bank;
+    bank.filter.setFilters(LPF, HPF, BSF);
+    m_filterBanks << bank;
+    switchGrabMode();
+    return m_filterBanks.size() - 1;
+}
+
+void NeuroplayDevice::removeFilterBanks()
+{
+    m_filterBanks.clear();
+    switchGrabMode();
+}
+
+void NeuroplayDevice::startLocalRecord(const QString &fileName, bool raw, double physicalRange)
+{
+    stopLocalRecord();
+    m_recordFileName = fileName;
+    m_recordRaw = raw;
+    m_recordRange = physicalRange;
+    m_recorderOpened = false;
+
+    m_recorderThread = new QThread(this);
+    m_recorderThread->setObjectName("NeuroplayDevice recorder");
+    m_recorder = new EdfRecorder;
+    m_recorder->moveToThread(m_recorderThread);
+    connect(m_recorderThread, &QThread::finished, m_recorder, &QObject::deleteLater);
+    connect(m_recorder, &EdfRecorder::finished, this, &NeuroplayDevice::localRecordFinished);
+    connect(m_recorder, &EdfRecorder::error, this, [=](QString text)
+    {
+        qCWarning(lcNeuroplay) << "local record:" << text;
+        emit localRecordFailed(text);
+    });
+    m_recorderThread->start();
+    switchGrabMode();
+}
+
+void NeuroplayDevice::stopLocalRecord()
+{
+    if (!m_recorder)
+        return;
+    closeRecorder();
+    switchGrabMode();
+}
+
+void NeuroplayDevice::closeRecorder()
+{
+    if (!m_recorder)
+        return;
+    // the rest of the queue is written and the header completed before the thread stops
+    QMetaObject::invokeMethod(m_recorder, "close", Qt::BlockingQueuedConnection);
+    m_recorderThread->quit();
+    m_recorderThread->wait();
+    delete m_recorderThread;
+    m_recorderThread = nullptr;
+    m_recorder = nullptr;
+}
+
 void NeuroplayDevice::grabRhythmsHistory(bool enable)
 {
     m_grabRhythms = enable;
@@ -72,34 +175,18 @@ void NeuroplayDevice::grabConcentrationHistory(bool enable)
     switchGrabMode();
 }
 
-NeuroplayDevice::ChannelsData NeuroplayDevice::readFilteredDataHistory()
+NeuroplayDevice::ChannelsData NeuroplayDevice::readFilteredDataHistory(SampleTiming *timing)
 {
-    ChannelsData result;
-    while (!m_filteredDataBuffer.isEmpty())
-    {
-        QVector<double> entry = m_filteredDataBuffer.dequeue();
-        int chnum = entry.size();
-        if (result.size() < chnum)
-            result.resize(chnum);
-        for (int i=0; i<chnum; i++)
-            result[i] << entry[i];
-    }
-    return result;
+    if (timing)
+        *timing = filteredDataTiming();
+    return m_filteredDataBuffer.read();
 }
 
-NeuroplayDevice::ChannelsData NeuroplayDevice::readRawDataHistory()
+NeuroplayDevice::ChannelsData NeuroplayDevice::readRawDataHistory(SampleTiming *timing)
 {
-    ChannelsData result;
-    while (!m_rawDataBuffer.isEmpty())
-    {
-        QVector<double> entry = m_rawDataBuffer.dequeue();
-        int chnum = entry.size();
-        if (result.size() < chnum)
-            result.resize(chnum);
-        for (int i=0; i<chnum; i++)
-            result[i] << entry[i];
-    }
-    return result;
+    if (timing)
+        *timing = rawDataTiming();
+    return m_rawDataBuffer.read();
 }
 
 QVector<NeuroplayDevice::ChannelsRhythms> NeuroplayDevice::readRhythmsHistory()
@@ -107,7 +194,7 @@ QVector<NeuroplayDevice::ChannelsRhythms> NeuroplayDevice::readRhythmsHistory()
     QVector<ChannelsRhythms> result;
     while (!m_rhythmsBuffer.isEmpty())
     {
-        result << m_rhythmsBuffer.dequeue();
+        result << rhythmsFromJson(m_rhythmsBuffer.dequeue());
     }
     return result;
 }
@@ -135,19 +222,29 @@ QVector<NeuroplayDevice::TimedValue> NeuroplayDevice::readConcentrationHistory()
 void NeuroplayDevice::setGrabInterval(int value_ms)
 {
     m_grabIntervalMs = value_ms;
-    m_grabTimer->setInterval(m_grabIntervalMs);
+    m_grabScheduler->setInterval(m_grabIntervalMs);
 }
 
 void NeuroplayDevice::start()
 {
     m_isStarted = false;
-    request({{"command", "startdevice"}, {"sn", m_serialNumber}});
+    m_filteredClock.reset(0);
+    m_rawClock.reset(0);
+    m_filteredContinuity.reset();
+    m_rawContinuity.reset();
+    m_startedChannels = m_preferredChannelCount;
+    request(CommandWriter("startdevice").add("sn", m_serialNumber).toUtf8());
 }
 
 void NeuroplayDevice::start(int channelNumber)
 {
     m_isStarted = false;
-    request({{"command", "startdevice"}, {"sn", m_serialNumber}, {"channels", channelNumber}});
+    m_filteredClock.reset(0);
+    m_rawClock.reset(0);
+    m_filteredContinuity.reset();
+    m_rawContinuity.reset();
+    m_startedChannels = channelNumber;
+    request(CommandWriter("startdevice").add("sn", m_serialNumber).add("channels", channelNumber).toUtf8());
 }
 
 void NeuroplayDevice::stop()
@@ -158,7 +255,11 @@ void NeuroplayDevice::stop()
     m_grabRhythms = false;
     m_grabMeditation = false;
     m_grabConcentration = false;
+    m_computeRhythms = false;
+    m_filterBanks.clear();
+    stopLocalRecord();
     switchGrabMode();
+    restoreStorageTime();
     request("stopdevice");
 }
 
@@ -172,253 +273,685 @@ void NeuroplayDevice::setStarted(bool started)
         emit ready();
 }
 
-void NeuroplayDevice::request(QString text)
+void NeuroplayDevice::request(const char *text)
 {
-    emit doRequest(text);
+    // literals are wrapped without copying
+    emit doRequest(QByteArray::fromRawData(text, int(qstrlen(text))));
 }
 
-void NeuroplayDevice::request(QJsonObject json)
+void NeuroplayDevice::request(const QByteArray &text)
 {
-    request(QJsonDocument(json).toJson());
+    emit doRequest(text);
 }
 
 void NeuroplayDevice::onResponse(QJsonObject resp)
 {
+    static MetricsHistogram *handling = NeuroplayMetrics::histogram("neuroplay_device_response_us", "Handling of a JSON response by the device");
+    MetricsTimer timer(handling);
     QString cmd = resp["command"].toString();
-    qDebug() << "received " << cmd;
+    NP_TRACE(lcNeuroplayRx) << "received" << cmd;
+
+    ResponseHandler handler = responseHandlers().value(cmd);
+    if (handler)
+        (this->*handler)(resp);
+}
 
-    if (cmd == "lastspectrum")
+const QHash<QString, NeuroplayDevice::ResponseHandler> &NeuroplayDevice::responseHandlers()
+{
+    static QHash<QString, ResponseHandler> handlers;
+    if (handlers.isEmpty())
     {
-        m_spectrum.clear();
-        QJsonArray arr = resp["spectrum"].toArray();
-        for (QJsonValueRef ch: arr)
-        {
-            QVector<double> array;
-            for (QJsonValueRef val: ch.toArray())
-                array << val.toDouble();
-            m_spectrum << array;
-        }
-        emit spectrumReady();
+        handlers["lastspectrum"] = &NeuroplayDevice::handleLastSpectrum;
+        handlers["spectrumfrequencies"] = &NeuroplayDevice::handleSpectrumFrequencies;
+        handlers["rhythms"] = &NeuroplayDevice::handleRhythms;
+        handlers["meditation"] = &NeuroplayDevice::handleMeditation;
+        handlers["concentration"] = &NeuroplayDevice::handleConcentration;
+        handlers["bci"] = &NeuroplayDevice::handleBCI;
+        handlers["enabledatagrabmode"] = &NeuroplayDevice::handleEnableDataGrabMode;
+        handlers["disabledatagrabmode"] = &NeuroplayDevice::handleDisableDataGrabMode;
+        handlers["filtereddata"] = &NeuroplayDevice::handleFilteredData;
+        handlers["rawdata"] = &NeuroplayDevice::handleRawData;
+        handlers["grabfiltereddata"] = &NeuroplayDevice::handleGrabFilteredData;
+        handlers["grabrawdata"] = &NeuroplayDevice::handleGrabRawData;
+        handlers["rhythmshistory"] = &NeuroplayDevice::handleRhythmsHistory;
+        handlers["meditationhistory"] = &NeuroplayDevice::handleMeditationHistory;
+        handlers["concentrationhistory"] = &NeuroplayDevice::handleConcentrationHistory;
+        handlers["stoprecord"] = &NeuroplayDevice::handleStopRecord;
     }
-    else if (cmd == "spectrumfrequencies")
+    return handlers;
+}
+
+bool NeuroplayDevice::handlesResponse(const QString &cmd)
+{
+    return responseHandlers().contains(cmd);
+}
+
+void NeuroplayDevice::handleLastSpectrum(const QJsonObject &resp)
+{
+    m_spectrumFrame.clear();
+    m_spectrumJson = resp["spectrum"].toArray();
+    m_spectrumPending = true;
+    if (hasSubscriber(&NeuroplayDevice::spectrumReady))
+        decodeSpectrum();
+    emit spectrumReady();
+}
+
+void NeuroplayDevice::handleSpectrumFrequencies(const QJsonObject &resp)
+{
+    m_spectrumFrequencies.clear();
+    for (QJsonValueRef val: resp["spectrum"].toArray())
+        m_spectrumFrequencies << val.toDouble();
+}
+
+void NeuroplayDevice::handleRhythms(const QJsonObject &resp)
+{
+    m_rhythmsJson = resp["rhythms"].toArray();
+    m_rhythmsPending = true;
+    if (hasSubscriber(&NeuroplayDevice::rhythmsReady))
+        decodeRhythms();
+    emit rhythmsReady();
+}
+
+void NeuroplayDevice::handleMeditation(const QJsonObject &resp)
+{
+    m_meditation = resp["meditation"].toDouble();
+    emit meditationReady();
+}
+
+void NeuroplayDevice::handleConcentration(const QJsonObject &resp)
+{
+    m_concentration = resp["concentration"].toDouble();
+    emit concentrationReady();
+}
+
+void NeuroplayDevice::handleBCI(const QJsonObject &resp)
+{
+    m_meditation = resp["meditation"].toDouble();
+    m_concentration = resp["concentration"].toDouble();
+    emit bciReady();
+}
+
+void NeuroplayDevice::handleEnableDataGrabMode(const QJsonObject &)
+{
+    m_grabScheduler->start();
+}
+
+void NeuroplayDevice::handleDisableDataGrabMode(const QJsonObject &)
+{
+    m_grabScheduler->stop();
+}
+
+void NeuroplayDevice::handleFilteredData(const QJsonObject &resp)
+{
+    ChannelsData data;
+    QJsonArray arr = resp["data"].toArray();
+    for (QJsonValueRef ch: arr)
     {
-        m_spectrumFrequencies.clear();
-        for (QJsonValueRef val: resp["spectrum"].toArray())
-            m_spectrumFrequencies << val.toDouble();
+        QVector<double> array;
+        for (QJsonValueRef val: ch.toArray())
+            array << val.toDouble();
+        data << array;
     }
-    else if (cmd == "rhythms")
+    emit filteredDataReceived(data);
+}
+
+void NeuroplayDevice::handleRawData(const QJsonObject &resp)
+{
+    ChannelsData data;
+    QJsonArray arr = resp["data"].toArray();
+    for (QJsonValueRef ch: arr)
     {
-        m_rhythms.clear();
-        QJsonArray arr = resp["rhythms"].toArray();
-        for (QJsonValueRef ch: arr)
-        {
-            QJsonObject o = ch.toObject();
-            Rhythms r;
-            r.delta = o["delta"].toDouble();
-            r.theta = o["theta"].toDouble();
-            r.alpha = o["alpha"].toDouble();
-            r.beta = o["beta"].toDouble();
-            r.gamma = o["gamma"].toDouble();
-            r.timestamp = o["t"].toInt();
-            m_rhythms << r;
-        }
-        emit rhythmsReady();
+        QVector<double> array;
+        for (QJsonValueRef val: ch.toArray())
+            array << val.toDouble();
+        data << array;
     }
-    else if (cmd == "meditation")
+    emit rawDataReceived(data);
+}
+
+void NeuroplayDevice::handleGrabFilteredData(const QJsonObject &resp)
+{
+    int count = appendGrabbedData(m_filteredDataBuffer, resp["data"].toArray());
+    count = checkGrabbedSamples(true, count, SampleClock::nowUs());
+    processFilteredData(count);
+    m_grabScheduler->received(GrabScheduler::FilteredDataStream, count);
+}
+
+void NeuroplayDevice::handleGrabRawData(const QJsonObject &resp)
+{
+    int count = appendGrabbedData(m_rawDataBuffer, resp["data"].toArray());
+    count = checkGrabbedSamples(false, count, SampleClock::nowUs());
+    processRawData(count);
+    m_grabScheduler->received(GrabScheduler::RawDataStream, count);
+}
+
+void NeuroplayDevice::handleRhythmsHistory(const QJsonObject &resp)
+{
+    // the entries are converted by readRhythmsHistory(), the newest one by rhythms()
+    const QJsonArray history = resp["history"].toArray();
+    for (const QJsonValue &entry: history)
+        m_rhythmsBuffer.enqueue(entry.toArray());
+    if (!history.isEmpty())
     {
-        m_meditation = resp["meditation"].toDouble();
-        emit meditationReady();
+        m_rhythmsJson = history.last().toArray();
+        m_rhythmsPending = true;
     }
-    else if (cmd == "concentration")
+    m_grabScheduler->received(GrabScheduler::RhythmsStream, history.size());
+}
+
+void NeuroplayDevice::handleMeditationHistory(const QJsonObject &resp)
+{
+    QJsonArray history = resp["history"].toArray();
+    for (QJsonValueRef entry: history)
     {
-        m_concentration = resp["concentration"].toDouble();
-        emit concentrationReady();
+        QJsonObject o = entry.toObject();
+        TimedValue tv;
+        tv.value = o["v"].toDouble();
+        tv.timestamp = o["t"].toInt();
+        m_meditation = tv.value;
+        m_meditationBuffer.enqueue(tv);
     }
-    else if (cmd == "bci")
+    m_grabScheduler->received(GrabScheduler::MeditationStream, history.size());
+}
+
+void NeuroplayDevice::handleConcentrationHistory(const QJsonObject &resp)
+{
+    QJsonArray history = resp["history"].toArray();
+    for (QJsonValueRef entry: history)
     {
-        m_meditation = resp["meditation"].toDouble();
-        m_concentration = resp["concentration"].toDouble();
-        emit bciReady();
+        QJsonObject o = entry.toObject();
+        TimedValue tv;
+        tv.value = o["v"].toDouble();
+        tv.timestamp = o["t"].toInt();
+        m_concentration = tv.value;
+        m_concentrationBuffer.enqueue(tv);
     }
-    else if (cmd == "enabledatagrabmode")
+    m_grabScheduler->received(GrabScheduler::ConcentrationStream, history.size());
+}
+
+void NeuroplayDevice::handleStopRecord(const QJsonObject &resp)
+{
+    if (!resp["result"].toBool())
+        return;
+
+    QByteArray edf, npd;
+    QJsonArray files = resp["files"].toArray();
+    for (QJsonValueRef file: files)
     {
-        m_grabTimer->start(m_grabIntervalMs);
+        QJsonObject o = file.toObject();
+        if (o["type"] == "edf")
+            edf = QByteArray::fromBase64(o["data"].toString().toLocal8Bit());
+        if (o["type"] == "npd")
+            npd = QByteArray::fromBase64(o["data"].toString().toLocal8Bit());
     }
-    else if (cmd == "disabledatagrabmode")
+    emit recordedData(edf, npd);
+}
+
+void NeuroplayDevice::onGrabFrame(QString cmd, QByteArray frame)
+{
+    NP_TRACE(lcNeuroplayRx) << "received" << cmd;
+
+    bool filtered = (cmd == "grabfiltereddata");
+    SampleRingBuffer &buffer = filtered? m_filteredDataBuffer: m_rawDataBuffer;
+    int count = GrabDecoder::decodeData(frame, buffer, historyCapacity());
+    if (count < 0)
+        count = appendGrabbedData(buffer, QJsonDocument::fromJson(frame).object()["data"].toArray());
+    // the frame was decoded in the thread it arrived in, right away
+    count = checkGrabbedSamples(filtered, count, SampleClock::nowUs());
+    if (filtered)
+        processFilteredData(count);
+    else
+        processRawData(count);
+    m_grabScheduler->received(filtered? GrabScheduler::FilteredDataStream: GrabScheduler::RawDataStream, count);
+}
+
+bool NeuroplayDevice::hasSubscriber(void (NeuroplayDevice::*signal)()) const
+{
+    return isSignalConnected(QMetaMethod::fromSignal(signal));
+}
+
+bool NeuroplayDevice::deferFrame(const QString &cmd, const QByteArray &frame)
+{
+    // with nobody to notify the frame isn't even parsed until spectrum() is read
+    if (cmd != "lastspectrum" || hasSubscriber(&NeuroplayDevice::spectrumReady))
+        return false;
+    // deep copy: the frame may be a view into memory that goes away, e.g. a replayed capture
+    m_spectrumFrame = QByteArray(frame.constData(), frame.size());
+    m_spectrumJson = QJsonArray();
+    m_spectrumPending = true;
+    return true;
+}
+
+void NeuroplayDevice::decodeSpectrum() const
+{
+    if (!m_spectrumPending)
+        return;
+    m_spectrumPending = false;
+    if (!m_spectrumFrame.isEmpty())
     {
-        m_grabTimer->stop();
+        m_spectrumJson = QJsonDocument::fromJson(m_spectrumFrame).object().value("spectrum").toArray();
+        m_spectrumFrame.clear();
     }
-    else if (cmd == "filtereddata")
+    // read through const arrays, which share the parsed data instead of detaching it
+    const QJsonArray channels = m_spectrumJson;
+    m_spectrumJson = QJsonArray();
+    m_spectrum.clear();
+    m_spectrum.reserve(channels.size());
+    for (const QJsonValue &ch: channels)
     {
-        ChannelsData data;
-        QJsonArray arr = resp["data"].toArray();
-        for (QJsonValueRef ch: arr)
-        {
-            QVector<double> array;
-            for (QJsonValueRef val: ch.toArray())
-                array << val.toDouble();
-            data << array;
-        }
-        emit filteredDataReceived(data);
+        const QJsonArray values = ch.toArray();
+        QVector<double> array;
+        array.reserve(values.size());
+        for (const QJsonValue &val: values)
+            array << val.toDouble();
+        m_spectrum << array;
     }
-    else if (cmd == "rawdata")
+}
+
+void NeuroplayDevice::decodeRhythms() const
+{
+    if (!m_rhythmsPending)
+        return;
+    m_rhythmsPending = false;
+    m_rhythms = rhythmsFromJson(m_rhythmsJson);
+    m_rhythmsJson = QJsonArray();
+}
+
+NeuroplayDevice::ChannelsRhythms NeuroplayDevice::rhythmsFromJson(const QJsonArray &arr)
+{
+    ChannelsRhythms chr;
+    chr.reserve(arr.size());
+    for (const QJsonValue &ch: arr)
     {
-        ChannelsData data;
-        QJsonArray arr = resp["data"].toArray();
-        for (QJsonValueRef ch: arr)
-        {
-            QVector<double> array;
-            for (QJsonValueRef val: ch.toArray())
-                array << val.toDouble();
-            data << array;
-        }
-        emit rawDataReceived(data);
+        QJsonObject o = ch.toObject();
+        Rhythms r;
+        r.delta = o["delta"].toDouble();
+        r.theta = o["theta"].toDouble();
+        r.alpha = o["alpha"].toDouble();
+        r.beta = o["beta"].toDouble();
+        r.gamma = o["gamma"].toDouble();
+        r.timestamp = o["t"].toInt();
+        chr << r;
     }
-    else if (cmd == "grabfiltereddata")
+    return chr;
+}
+
+bool NeuroplayDevice::onRecordFrame(const QByteArray &frame)
+{
+    QVector<GrabDecoder::StringRef> files = GrabDecoder::recordFiles(frame);
+    if (files.isEmpty())
+        return false;
+
+    qint64 total = 0, done = 0;
+    for (const GrabDecoder::StringRef &file: files)
+        total += file.size;
+
+    qint64 edfBytes = 0, npdBytes = 0;
+    QByteArray chunk(Base64Decoder::maxDecodedSize(RecordChunkSize), Qt::Uninitialized);
+    for (const GrabDecoder::StringRef &file: files)
     {
-        QJsonArray arr = resp["data"].toArray();
-        int chnum = arr.size();
-        int count = arr[0].toArray().size();
-        for (int i=0; i<count; i++)
+        bool edf = (file.name == "edf");
+        QIODevice *sink = edf? m_edfSink.data(): (file.name == "npd")? m_npdSink.data(): nullptr;
+        if (!sink)
         {
-            QVector<double> entry;
-            for (int j=0; j<chnum; j++)
-            {
-                entry << arr[j].toArray()[i].toDouble();
-            }
-            m_filteredDataBuffer.enqueue(entry);
+            done += file.size;
+            continue;
         }
-    }
-    else if (cmd == "grabrawdata")
-    {
-        QJsonArray arr = resp["data"].toArray();
-        int chnum = arr.size();
-        int count = arr[0].toArray().size();
-        for (int i=0; i<count; i++)
+
+        Base64Decoder decoder;
+        qint64 &written = edf? edfBytes: npdBytes;
+        const char *data = frame.constData() + file.offset;
+        for (int pos=0; pos<file.size; pos+=RecordChunkSize)
         {
-            QVector<double> entry;
-            for (int j=0; j<chnum; j++)
+            int size = qMin(RecordChunkSize, file.size - pos);
+            int n = decoder.decode(data + pos, size, chunk.data());
+            if (n < 0)
             {
-                entry << arr[j].toArray()[i].toDouble();
+                // the sinks got a truncated file, it is not reported as saved
+                qCWarning(lcNeuroplay) << "stoprecord:" << file.name << "is not valid base64";
+                emit recordFailed(QString("%1 file of the record is not valid base64").arg(file.name));
+                return true;
             }
-            m_rawDataBuffer.enqueue(entry);
+            n += (pos + size == file.size)? decoder.finish(chunk.data() + n): 0;
+            sink->write(chunk.constData(), n);
+            written += n;
+            done += size;
+            emit recordProgress(done, total);
         }
     }
-    else if (cmd == "rhythmshistory")
+    emit recordSaved(edfBytes, npdBytes);
+    return true;
+}
+
+void NeuroplayDevice::onSampleBlock(const QString &cmd, const ChannelsData &data, qint64 arrivalUs)
+{
+    NP_TRACE(lcNeuroplayRx) << "received" << cmd;
+
+    bool filtered = (cmd == "grabfiltereddata");
+    SampleRingBuffer &buffer = filtered? m_filteredDataBuffer: m_rawDataBuffer;
+    if (!data.isEmpty() && buffer.channels() != data.size())
+        buffer.reset(data.size(), historyCapacity());
+    buffer.append(data);
+    int count = data.isEmpty()? 0: data[0].size();
+    count = checkGrabbedSamples(filtered, count, arrivalUs);
+    if (filtered)
+        processFilteredData(count);
+    else
+        processRawData(count);
+    m_grabScheduler->received(filtered? GrabScheduler::FilteredDataStream: GrabScheduler::RawDataStream, count);
+}
+
+void NeuroplayDevice::switchGrabMode()
+{
+    bool enable = false;
+    bool recording = isLocalRecording();
+    if (m_grabFilteredData || m_grabRawData || m_grabRhythms || m_grabMeditation || m_grabConcentration || m_computeRhythms
+            || !m_filterBanks.isEmpty() || recording)
+        enable = true;
+
+    // with local filters the filtered samples are made from the raw ones
+    bool filtered = m_grabFilteredData || m_computeRhythms || (recording && !m_recordRaw);
+    bool raw = m_grabRawData || !m_filterBanks.isEmpty() || (recording && m_recordRaw) || (filtered && m_localFiltering);
+    m_grabScheduler->setEnabled(GrabScheduler::FilteredDataStream, filtered && !m_localFiltering);
+    m_grabScheduler->setEnabled(GrabScheduler::RawDataStream, raw);
+    m_grabScheduler->setEnabled(GrabScheduler::RhythmsStream, m_grabRhythms);
+    m_grabScheduler->setEnabled(GrabScheduler::MeditationStream, m_grabMeditation);
+    m_grabScheduler->setEnabled(GrabScheduler::ConcentrationStream, m_grabConcentration);
+
+    if (enable && !m_grabScheduler->isActive())
+        request("enabledatagrabmode");
+    else if (!enable)
     {
-        QJsonArray history = resp["history"].toArray();
-        for (QJsonValueRef entry: history)
-        {
-            ChannelsRhythms chr;
-            QJsonArray arr = entry.toArray();
-            for (QJsonValueRef ch: arr)
-            {
-                QJsonObject o = ch.toObject();
-                Rhythms r;
-                r.delta = o["delta"].toDouble();
-                r.theta = o["theta"].toDouble();
-                r.alpha = o["alpha"].toDouble();
-                r.beta = o["beta"].toDouble();
-                r.gamma = o["gamma"].toDouble();
-                r.timestamp = o["t"].toInt();
-                chr << r;
-            }
-            m_rhythms = chr;
-            m_rhythmsBuffer.enqueue(chr);
-        }
+        request("disabledatagrabmode");
+        m_grabScheduler->stop();
     }
-    else if (cmd == "meditationhistory")
+}
+
+int NeuroplayDevice::historyCapacity() const
+{
+    int frequency = 0;
+    for (auto mode: m_channelModes)
+        frequency = qMax(frequency, mode.second);
+    if (!frequency)
+        frequency = 500;
+    return frequency * HistorySeconds;
+}
+
+int NeuroplayDevice::frequency(int channels) const
+{
+    // the mode the device was started with, if it can be told by the channel count
+    int frequency = 0;
+    for (auto mode: m_channelModes)
     {
-        QJsonArray history = resp["history"].toArray();
-        for (QJsonValueRef entry: history)
-        {
-            QJsonObject o = entry.toObject();
-            TimedValue tv;
-            tv.value = o["v"].toDouble();
-            tv.timestamp = o["t"].toInt();
-            m_meditation = tv.value;
-            m_meditationBuffer.enqueue(tv);
-        }
+        if (mode.first == channels)
+            return mode.second;
+        frequency = qMax(frequency, mode.second);
     }
-    else if (cmd == "concentrationhistory")
+    return frequency? frequency: 500;
+}
+
+void NeuroplayDevice::processFilteredData(int count)
+{
+    if (count <= 0)
+        return;
+    if (m_recorder && !m_recordRaw)
+        recordSamples(m_filteredDataBuffer, count);
+    emit filteredSamplesAppended(count);
+    if (!m_computeRhythms)
+        return;
+
+    const SampleRingBuffer &buffer = m_filteredDataBuffer;
+    if (m_bandPower.channels() != buffer.channels())
     {
-        QJsonArray history = resp["history"].toArray();
-        for (QJsonValueRef entry: history)
-        {
-            QJsonObject o = entry.toObject();
-            TimedValue tv;
-            tv.value = o["v"].toDouble();
-            tv.timestamp = o["t"].toInt();
-            m_concentration = tv.value;
-            m_concentrationBuffer.enqueue(tv);
-        }
+        int rate = frequency(buffer.channels());
+        m_bandPower.reset(buffer.channels(), rate, m_bandPowerWindow, qMax(rate * m_bandPowerStepMs / 1000, 1));
     }
-    else if (cmd == "stoprecord" && resp["result"].toBool())
+    if (!m_bandPower.append(buffer, count))
+        return;
+
+    m_rhythmsJson = QJsonArray();
+    m_rhythmsPending = false;
+    m_rhythms.resize(m_bandPower.channels());
+    for (int j=0; j<m_rhythms.size(); j++)
     {
-        QByteArray edf, npd;
-        QJsonArray files = resp["files"].toArray();
-        for (QJsonValueRef file: files)
-        {
-            QJsonObject o = file.toObject();
-            if (o["type"] == "edf")
-                edf = QByteArray::fromBase64(o["data"].toString().toLocal8Bit());
-            if (o["type"] == "npd")
-                npd = QByteArray::fromBase64(o["data"].toString().toLocal8Bit());
-        }
-        emit recordedData(edf, npd);
+        Rhythms &r = m_rhythms[j];
+        r.delta = m_bandPower.power(j, BandPowerEngine::Delta);
+        r.theta = m_bandPower.power(j, BandPowerEngine::Theta);
+        r.alpha = m_bandPower.power(j, BandPowerEngine::Alpha);
+        r.beta = m_bandPower.power(j, BandPowerEngine::Beta);
+        r.gamma = m_bandPower.power(j, BandPowerEngine::Gamma);
+        r.timestamp = int(m_bandPower.timestampMs());
     }
+    emit rhythmsReady();
+
+    // the power spectral density of the same window, over the range the server reports;
+    // kept apart from spectrum(), which is in the server's units
+    int bins = 0;
+    while (bins < m_bandPower.bins() && m_bandPower.binFrequency(bins) <= LocalSpectrumMaxHz)
+        bins++;
+    m_localSpectrumFrequencies.resize(bins);
+    for (int i=0; i<bins; i++)
+        m_localSpectrumFrequencies[i] = m_bandPower.binFrequency(i);
+    m_localSpectrum.resize(m_bandPower.channels());
+    for (int j=0; j<m_localSpectrum.size(); j++)
+    {
+        const double *spectrum = m_bandPower.spectrum(j);
+        m_localSpectrum[j].resize(bins);
+        for (int i=0; i<bins; i++)
+            m_localSpectrum[j][i] = spectrum[i];
+    }
+    emit localSpectrumReady();
 }
 
-void NeuroplayDevice::switchGrabMode()
+void NeuroplayDevice::samplesAppended(bool filtered, int count)
 {
-    bool enable = false;
-    if (m_grabFilteredData || m_grabRawData || m_grabRhythms || m_grabMeditation || m_grabConcentration)
-        enable = true;
+    stampSamples(filtered, count, SampleClock::nowUs());
+    if (filtered)
+        processFilteredData(count);
+    else
+        processRawData(count);
+}
 
-    if (enable && !m_grabTimer->isActive())
-        request("enabledatagrabmode");
-    else if (!enable)
+void NeuroplayDevice::processRawData(int count)
+{
+    if (count <= 0)
+        return;
+
+    const SampleRingBuffer &raw = m_rawDataBuffer;
+    if (m_recorder && m_recordRaw)
+        recordSamples(raw, count);
+    int rate = frequency(raw.channels());
+    if (m_localFiltering)
     {
-        request("disabledatagrabmode");
-        m_grabTimer->stop();
+        if (m_localFilter.channels() != raw.channels() || m_localFilter.sampleRate() != rate)
+            m_localFilter.reset(raw.channels(), rate);
+        m_localFilter.process(raw, count, m_filteredDataBuffer, historyCapacity());
+        stampSamples(true, count, m_rawClock.lastArrivalUs());
+        processFilteredData(count);
+    }
+    for (FilterBank &bank: m_filterBanks)
+    {
+        if (bank.filter.channels() != raw.channels() || bank.filter.sampleRate() != rate)
+            bank.filter.reset(raw.channels(), rate);
+        bank.filter.process(raw, count, bank.buffer, historyCapacity());
+    }
+}
+
+void NeuroplayDevice::recordSamples(const SampleRingBuffer &buffer, int count)
+{
+    count = qMin(count, buffer.size());
+    if (!m_recorderOpened)
+    {
+        // the file layout is known with the first block; -range - 0.1 keeps 0.1 uV steps for the default range
+        QMetaObject::invokeMethod(m_recorder, "open", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_recordFileName), Q_ARG(int, buffer.channels()),
+                                  Q_ARG(int, frequency(buffer.channels())),
+                                  Q_ARG(double, -m_recordRange - 0.1), Q_ARG(double, m_recordRange));
+        m_recorderOpened = true;
+    }
+
+    SampleBlock block;
+    block.command = m_recordRaw? "grabrawdata": "grabfiltereddata";
+    block.timeUs = (m_recordRaw? m_rawClock: m_filteredClock).lastArrivalUs();
+    block.data.resize(buffer.channels());
+    for (int j=0; j<buffer.channels(); j++)
+    {
+        SampleRingBuffer::Span s = buffer.span(j);
+        QVector<double> &dst = block.data[j];
+        dst.resize(count);
+        for (int i=0; i<count; i++)
+            dst[i] = s[s.size() - count + i];
+    }
+    if (!m_recorder->samples().push(block))
+        m_recorder->countDroppedBlock();
+    QMetaObject::invokeMethod(m_recorder, "writePending", Qt::QueuedConnection);
+}
+
+void NeuroplayDevice::stampSamples(bool filtered, int count, qint64 arrivalUs)
+{
+    SampleClock &clock = filtered? m_filteredClock: m_rawClock;
+    int rate = frequency((filtered? m_filteredDataBuffer: m_rawDataBuffer).channels());
+    if (clock.sampleRate() != rate)
+        clock.reset(rate);
+    clock.addBlock(count, arrivalUs);
+}
+
+int NeuroplayDevice::checkGrabbedSamples(bool filtered, int count, qint64 arrivalUs)
+{
+    SampleRingBuffer &buffer = filtered? m_filteredDataBuffer: m_rawDataBuffer;
+    StreamContinuity &continuity = filtered? m_filteredContinuity: m_rawContinuity;
+    const SampleClock &clock = filtered? m_filteredClock: m_rawClock;
+    // a new channel mode starts a new stream
+    if (clock.sampleRate() != frequency(buffer.channels()))
+        continuity.reset();
+    count = continuity.check(buffer, count, clock, arrivalUs);
+    stampSamples(filtered, count, arrivalUs);
+
+    int lost = continuity.lastGap(), repeated = continuity.lastRepeated();
+    if (lost || repeated)
+    {
+        qCWarning(lcNeuroplay) << (filtered? "filtered": "raw") << "data:" << lost << "samples lost,"
+                               << repeated << "repeated";
+        if (lost && m_adaptiveGrab)
+            adaptToGap(continuity.lastIntervalUs());
+        emit discontinuity(filtered, lost, repeated);
+    }
+    return count;
+}
+
+void NeuroplayDevice::adaptToGap(qint64 intervalUs)
+{
+    // the server dropped samples before they were polled: poll more often...
+    int interval = qMax(m_grabIntervalMs / 2, MinAdaptiveGrabIntervalMs);
+    if (interval < m_grabIntervalMs)
+        setGrabInterval(interval);
+    // ...and have it keep twice the longest time between polls seen, unless it already keeps longer
+    int seconds = qMin(int(intervalUs * 2 / 1000000) + 1, MaxStorageTimeSeconds);
+    if (seconds > qMax(m_requestedStorageTime, m_serverStorageTime))
+    {
+        if (!m_requestedStorageTime)
+            m_restoreStorageTime = m_serverStorageTime;
+        m_requestedStorageTime = seconds;
+        //! @bug "value" value expected as string instead of number!
+        request(CommandWriter("setdatastoragetime").add("value", QString::number(seconds)).toUtf8());
+        request("getdatastoragetime");
+    }
+    qCDebug(lcNeuroplay) << "grab interval" << m_grabIntervalMs << "ms, storage time" << m_requestedStorageTime << "s";
+}
+
+void NeuroplayDevice::restoreStorageTime()
+{
+    // the storage time is shared by all clients of the server and outlives this one
+    if (m_requestedStorageTime && m_restoreStorageTime > 0)
+    {
+        request(CommandWriter("setdatastoragetime").add("value", QString::number(m_restoreStorageTime)).toUtf8());
+        request("getdatastoragetime");
     }
+    m_requestedStorageTime = 0;
+    m_restoreStorageTime = 0;
+}
+
+NeuroplayDevice::SampleTiming NeuroplayDevice::sampleTiming(const SampleRingBuffer &buffer, const SampleClock &clock)
+{
+    SampleTiming timing;
+    timing.firstSample = clock.sampleCount() - buffer.size();
+    timing.firstTimeUs = clock.timeUs(timing.firstSample);
+    timing.periodUs = clock.periodUs();
+    return timing;
 }
 
-void NeuroplayDevice::grabRequest()
+int NeuroplayDevice::appendGrabbedData(SampleRingBuffer &buffer, const QJsonArray &arr)
 {
-    if (m_grabFilteredData)
+    int chnum = arr.size();
+    if (!chnum)
+        return 0;
+    if (buffer.channels() != chnum)
+        buffer.reset(chnum, historyCapacity());
+
+    int count = arr[0].toArray().size();
+    for (int j=0; j<chnum; j++)
+    {
+        QJsonArray ch = arr[j].toArray();
+        SampleRingBuffer::Writer w = buffer.writer(j);
+        for (int i=0; i<count; i++)
+            w.put(ch.at(i).toDouble());
+    }
+    buffer.commit(count);
+    return count;
+}
+
+void NeuroplayDevice::grabRequest(int stream)
+{
+    static MetricsCounter *requests = NeuroplayMetrics::counter("neuroplay_grab_requests_total", "Grab polls sent by the devices");
+    requests->add();
+    switch (stream)
+    {
+    case GrabScheduler::FilteredDataStream:
         request("grabrawdata");
-    if (m_grabRawData)
+        break;
+    case GrabScheduler::RawDataStream:
         request("graboriginaldata");
-    if (m_grabRhythms)
+        break;
+    case GrabScheduler::RhythmsStream:
         request("rhythmsHistory");
-    if (m_grabMeditation)
+        break;
+    case GrabScheduler::MeditationStream:
         request("meditationHistory");
-    if (m_grabConcentration)
+        break;
+    case GrabScheduler::ConcentrationStream:
         request("concentrationHistory");
+        break;
+    }
 }
 
 // ====================== NeuroplayPro ========================= //
 
 NeuroplayPro::NeuroplayPro(QObject *parent) : QObject(parent),
+    m_thread(nullptr),
     m_state(Disconnected),
     m_isDataGrab(false),
     m_currentDevice(nullptr),
+    m_lastRequester(nullptr),
+    m_savedDispatches(0),
+    m_flushScheduled(false),
     m_LPF(0), m_HPF(0), m_BSF(0),
     m_dataStorageTime(0)
 {
-    socket = new QWebSocket();
-    connect(socket, &QWebSocket::connected, [=]()
+    m_socket = new SocketWorker();
+    connect(m_socket, &SocketWorker::connected, this, [=]()
     {
         m_state = Connected;
         send("help");
     });
-    connect(socket, &QWebSocket::disconnected, [=]()
+    connect(m_socket, &SocketWorker::disconnected, this, [=]()
     {
         m_state = Disconnected;
         emit disconnected();
     });
-    connect(socket, &QWebSocket::textMessageReceived, this, &NeuroplayPro::onSocketResponse);
+    connect(m_socket, &SocketWorker::frameReceived, this, &NeuroplayPro::onSocketFrame);
+    connect(m_socket, &SocketWorker::responseReceived, this, &NeuroplayPro::onResponse);
+    connect(m_socket, &SocketWorker::samplesReceived, this, &NeuroplayPro::onSamplesReceived);
+    connect(this, &NeuroplayPro::sendFrame, m_socket, &SocketWorker::sendFrame);
 
     m_searchTimer = new QTimer(this);
     m_searchTimer->setInterval(200);
@@ -433,16 +966,65 @@ NeuroplayPro::NeuroplayPro(QObject *parent) : QObject(parent),
     {
         send("currentdeviceinfo");
     });
+
+    m_devStartTimeout = new QTimer(this);
+    m_devStartTimeout->setInterval(6000);
+    m_devStartTimeout->setSingleShot(true);
+    connect(m_devStartTimeout, &QTimer::timeout, this, &NeuroplayPro::failDeviceStart);
 }
 
 NeuroplayPro::~NeuroplayPro()
 {
     close();
+    if (m_thread)
+    {
+        // the worker is deleted by the finished thread
+        m_thread->quit();
+        m_thread->wait();
+    }
+    else
+    {
+        delete m_socket;
+    }
+}
+
+void NeuroplayPro::enableWorkerThread()
+{
+    if (m_thread)
+        return;
+    m_thread = new QThread(this);
+    m_thread->setObjectName("NeuroplayPro socket");
+    m_socket->setDecoding(true);
+    m_socket->moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, m_socket, &QObject::deleteLater);
+    m_thread->start();
+}
+
+void NeuroplayPro::setTransport(Transport *transport)
+{
+    if (!transport)
+        return;
+    qRegisterMetaType<Transport*>();
+    if (m_thread)
+        transport->moveToThread(m_thread);
+    QMetaObject::invokeMethod(m_socket, "setTransport", m_thread? Qt::BlockingQueuedConnection: Qt::DirectConnection,
+                              Q_ARG(Transport*, transport));
 }
 
 void NeuroplayPro::open()
 {
-    socket->open(QUrl("ws://localhost:1336"));
+    QMetaObject::invokeMethod(m_socket, "open");
+}
+
+void NeuroplayPro::startCapture(const QString &fileName)
+{
+    QMetaObject::invokeMethod(m_socket, "startCapture", m_thread? Qt::BlockingQueuedConnection: Qt::DirectConnection,
+                              Q_ARG(QString, fileName));
+}
+
+void NeuroplayPro::stopCapture()
+{
+    QMetaObject::invokeMethod(m_socket, "stopCapture", m_thread? Qt::BlockingQueuedConnection: Qt::DirectConnection);
 }
 
 void NeuroplayPro::close()
@@ -451,28 +1033,67 @@ void NeuroplayPro::close()
         dev->deleteLater();
     m_deviceMap.clear();
     m_deviceList.clear();
-    socket->close();
+    m_currentDevice = nullptr;
+    m_lastRequester = nullptr;
+    m_startingDevice = nullptr;
+    m_devStartTimer->stop();
+    m_devStartTimeout->stop();
+    m_requests.clear();
+    QMetaObject::invokeMethod(m_socket, "close", m_thread? Qt::BlockingQueuedConnection: Qt::DirectConnection);
 }
 
 void NeuroplayPro::send(QString cmd)
 {
-    qDebug() << "> " + cmd;
-    socket->sendTextMessage(cmd);
-//    emit response("> " + cmd);
+    // a command typed again is meant to be sent again
+    send(cmd.toUtf8(), false);
 }
 
-void NeuroplayPro::send(QJsonObject obj)
+void NeuroplayPro::send(const char *cmd)
 {
-    send(QJsonDocument(obj).toJson());
+    send(QByteArray::fromRawData(cmd, int(qstrlen(cmd))));
+}
+
+void NeuroplayPro::send(const QByteArray &cmd, bool deduplicate)
+{
+    if (!m_requests.enqueue(cmd, deduplicate))
+        return;
+    if (!m_flushScheduled)
+    {
+        // everything requested during this event loop iteration goes out in one flush
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushRequests", Qt::QueuedConnection);
+    }
+}
+
+void NeuroplayPro::flushRequests()
+{
+    static MetricsGauge *inFlight = NeuroplayMetrics::gauge("neuroplay_requests_in_flight", "Requests waiting for their response");
+    m_flushScheduled = false;
+    m_requests.expire();
+    for (const RequestQueue::Request &r: m_requests.takeQueued())
+    {
+        NP_TRACE(lcNeuroplayTx) << ">" << r.text;
+        emit sendFrame(r.text);
+//        emit response("> " + r.text);
+    }
+    inFlight->set(m_requests.inFlightCount());
+}
+
+void NeuroplayPro::onDeviceRequest(QByteArray cmd)
+{
+    m_lastRequester = qobject_cast<NeuroplayDevice*>(sender());
+    if (RequestQueue::commandOf(cmd) == "startdevice")
+        m_startingDevice = m_lastRequester;
+    send(cmd);
 }
 
 NeuroplayDevice *NeuroplayPro::createDevice(const QJsonObject &o)
 {
     NeuroplayDevice *dev = new NeuroplayDevice(o);
-    qDebug() << "device created" << dev->name();
-    QObject::connect(dev, SIGNAL(doRequest(QString)), this, SLOT(send(QString)));//, Qt::QueuedConnection);
-    QObject::connect(this, SIGNAL(responseJson(QJsonObject)), dev, SLOT(onResponse(QJsonObject)));//, Qt::QueuedConnection);
+    qCDebug(lcNeuroplay) << "device created" << dev->name();
+    QObject::connect(dev, SIGNAL(doRequest(QByteArray)), this, SLOT(onDeviceRequest(QByteArray)));//, Qt::QueuedConnection);
     dev->m_id = m_deviceList.size();
+    dev->m_serverStorageTime = m_dataStorageTime;
     m_deviceMap[dev->name()] = dev;
     m_deviceList << dev;
     emit deviceConnected(dev);
@@ -481,158 +1102,318 @@ NeuroplayDevice *NeuroplayPro::createDevice(const QJsonObject &o)
 
 void NeuroplayPro::onSocketResponse(const QString &text)
 {
-    QJsonDocument json = QJsonDocument::fromJson(text.toUtf8());
-    QJsonObject resp = json.object();
-    QString cmd = resp["command"].toString();
-    bool result = resp["result"].toBool();
+    onSocketFrame(text.toUtf8());
+}
 
-    emit responseJson(resp);
+void NeuroplayPro::onSocketFrame(const QByteArray &frame)
+{
+    static MetricsHistogram *handling = NeuroplayMetrics::histogram("neuroplay_frame_decode_us", "Decoding and dispatch of a frame in the SDK thread");
+    MetricsTimer timer(handling);
 
-    if (resp.contains("error") && m_state == Ready)
+    // sample payloads are decoded by the device straight from the frame, without the JSON tree
+    QString frameCmd = GrabDecoder::peekCommand(frame);
+    if (GrabDecoder::isSampleFrame(frameCmd, frame))
     {
-        emit error(resp["error"].toString());
+        respond(frameCmd);
+        NeuroplayDevice *dev = responseTarget();
+        if (dev)
+            dev->onGrabFrame(frameCmd, frame);
+        countDispatches(dev? 1: 0);
         return;
     }
 
-    if (cmd == "help")
+    // recordings can be hundreds of MB, they go to the sinks without the JSON tree and its string copies
+    if (frameCmd == "stoprecord")
     {
-        QString help;
-        QJsonArray arr = resp["commands"].toArray();
-        for (QJsonValueRef value: arr)
+        NeuroplayDevice *dev = responseTarget();
+        if (dev && dev->hasRecordSinks() && dev->onRecordFrame(frame))
         {
-            QJsonObject o = value.toObject();
-            QString c = o["command"].toString();
-            QString d = o["description"].toString();
-            m_commands[c] = d;
-            if (d.isEmpty())
-                help += c + "\n";
-            else
-                help += c + " \t - " + m_commands[c] + "\n";
+            respond(frameCmd);
+            countDispatches(1);
+            return;
         }
+    }
 
-        // aqcuire current settings:
-        send("version");
-        send("getfavoritedevicename");
-        send("getfilters");
-        send("getdatastoragetime");
-
-        // aqcuire current connected device.
-        // the search will started later if device is not connected
-        send("currentdeviceinfo");
-
-        bool need_emit = (m_state < Searching);
-        m_state = Searching;
-        if (need_emit)
+    // unwatched device responses wait as frames until they are read, errors are reported right away
+    if (frameCmd == "lastspectrum" && !isSignalConnected(QMetaMethod::fromSignal(&NeuroplayPro::responseJson))
+        && !frame.contains("\"error\""))
+    {
+        NeuroplayDevice *dev = responseTarget();
+        if (dev && dev->deferFrame(frameCmd, frame))
         {
-            emit connected();
+            respond(frameCmd);
+            countDispatches(1);
             return;
         }
+    }
+
+    onResponse(QJsonDocument::fromJson(frame).object());
+}
+
+void NeuroplayPro::onResponse(const QJsonObject &resp)
+{
+    QString cmd = resp["command"].toString();
+    respond(cmd);
+
+    emit responseJson(resp);
+
+    // device responses are meant for the device the server is working with
+    NeuroplayDevice *dev = NeuroplayDevice::handlesResponse(cmd)? responseTarget(): nullptr;
+    if (dev)
+        dev->onResponse(resp);
+    countDispatches(dev? 1: 0);
 
-//        emit response(help);
+    if (resp.contains("error") && m_state == Ready)
+    {
+        if (cmd == "startdevice")
+            failDeviceStart();
+        emit error(resp["error"].toString());
         return;
     }
-    else if (cmd == "version" && result)
+
+    ResponseHandler handler = responseHandlers().value(cmd);
+    if (handler)
+        (this->*handler)(resp);
+}
+
+void NeuroplayPro::onSamplesReceived()
+{
+    static MetricsHistogram *handling = NeuroplayMetrics::histogram("neuroplay_frame_decode_us", "Decoding and dispatch of a frame in the SDK thread");
+    static MetricsGauge *queued = NeuroplayMetrics::gauge("neuroplay_sample_blocks_queued", "Decoded sample blocks waiting for the device");
+    SampleBlock block;
+    while (m_socket->samples().pop(block))
     {
-        m_version = resp["version"].toString();
+        MetricsTimer timer(handling);
+        respond(block.command);
+        NeuroplayDevice *dev = responseTarget();
+        if (dev)
+            dev->onSampleBlock(block.command, block.data, block.timeUs);
+        countDispatches(dev? 1: 0);
     }
-    else if (cmd == "getfavoritedevicename")
+    queued->set(m_socket->samples().size());
+}
+
+const QHash<QString, NeuroplayPro::ResponseHandler> &NeuroplayPro::responseHandlers()
+{
+    static QHash<QString, ResponseHandler> handlers;
+    if (handlers.isEmpty())
     {
-        m_favoriteDeviceName = resp["device"].toString();
+        handlers["help"] = &NeuroplayPro::handleHelp;
+        handlers["version"] = &NeuroplayPro::handleVersion;
+        handlers["getfavoritedevicename"] = &NeuroplayPro::handleFavoriteDeviceName;
+        handlers["getfilters"] = &NeuroplayPro::handleFilters;
+        handlers["setdefaultfilters"] = &NeuroplayPro::handleFilters;
+        handlers["getdatastoragetime"] = &NeuroplayPro::handleDataStorageTime;
+        handlers["startsearch"] = &NeuroplayPro::handleStartSearch;
+        handlers["listdevices"] = &NeuroplayPro::handleListDevices;
+        handlers["startdevice"] = &NeuroplayPro::handleStartDevice;
+        handlers["currentdeviceinfo"] = &NeuroplayPro::handleCurrentDeviceInfo;
+        handlers["enabledatagrabmode"] = &NeuroplayPro::handleEnableDataGrabMode;
+        handlers["disabledatagrabmode"] = &NeuroplayPro::handleDisableDataGrabMode;
     }
-    else if (cmd == "getfilters" || cmd == "setdefaultfilters")
+    return handlers;
+}
+
+void NeuroplayPro::respond(const QString &cmd)
+{
+    static MetricsHistogram *roundTrip = NeuroplayMetrics::histogram("neuroplay_request_round_trip_us", "Time from sending a request to its response");
+    static MetricsGauge *inFlight = NeuroplayMetrics::gauge("neuroplay_requests_in_flight", "Requests waiting for their response");
+    // the server echoes any command sent, e.g. typed ones; a label for each would grow without bound
+    QString label = (responseHandlers().contains(cmd) || NeuroplayDevice::handlesResponse(cmd))? cmd: QString("other");
+    MetricsCounter *&frames = m_frameCounters[label];
+    if (!frames)
+        frames = NeuroplayMetrics::counter(NeuroplayMetrics::name("neuroplay_frames_total", "command", label), "Responses received, by command");
+    frames->add();
+
+    qint64 rtt = m_requests.respond(cmd);
+    if (rtt >= 0)
+        roundTrip->record(rtt * 1000);
+    inFlight->set(m_requests.inFlightCount());
+}
+
+NeuroplayDevice *NeuroplayPro::responseTarget() const
+{
+    return m_currentDevice? m_currentDevice: m_lastRequester;
+}
+
+void NeuroplayPro::countDispatches(int delivered)
+{
+    // every response used to be broadcast to all created devices
+    m_savedDispatches += quint64(qMax(m_deviceList.size() - delivered, 0));
+}
+
+void NeuroplayPro::handleHelp(const QJsonObject &resp)
+{
+    QString help;
+    QJsonArray arr = resp["commands"].toArray();
+    for (QJsonValueRef value: arr)
     {
-        m_LPF = resp["LPF"].toDouble(0);
-        m_HPF = resp["HPF"].toDouble(0);
-        m_BSF = resp["BSF"].toDouble(0);
+        QJsonObject o = value.toObject();
+        QString c = o["command"].toString();
+        QString d = o["description"].toString();
+        m_commands[c] = d;
+        if (d.isEmpty())
+            help += c + "\n";
+        else
+            help += c + " \t - " + m_commands[c] + "\n";
     }
-    else if (cmd == "getdatastoragetime")
+
+    // aqcuire current settings:
+    send("version");
+    send("getfavoritedevicename");
+    send("getfilters");
+    send("getdatastoragetime");
+
+    // aqcuire current connected device.
+    // the search will started later if device is not connected
+    send("currentdeviceinfo");
+
+    bool need_emit = (m_state < Searching);
+    m_state = Searching;
+    if (need_emit)
+        emit connected();
+
+//    emit response(help);
+}
+
+void NeuroplayPro::handleVersion(const QJsonObject &resp)
+{
+    if (!resp["result"].toBool())
+        return;
+
+    m_version = resp["version"].toString();
+}
+
+void NeuroplayPro::handleFavoriteDeviceName(const QJsonObject &resp)
+{
+    m_favoriteDeviceName = resp["device"].toString();
+}
+
+void NeuroplayPro::handleFilters(const QJsonObject &resp)
+{
+    m_LPF = resp["LPF"].toDouble(0);
+    m_HPF = resp["HPF"].toDouble(0);
+    m_BSF = resp["BSF"].toDouble(0);
+}
+
+void NeuroplayPro::handleDataStorageTime(const QJsonObject &resp)
+{
+    m_dataStorageTime = resp["storagetime"].toInt();
+    for (NeuroplayDevice *dev: m_deviceList)
+        dev->m_serverStorageTime = m_dataStorageTime;
+}
+
+void NeuroplayPro::handleStartSearch(const QJsonObject &)
+{
+    for (NeuroplayDevice *dev: m_deviceList)
+        dev->m_isConnected = false;
+    m_searchTimer->start();
+    QTimer::singleShot(6000, [=]()
     {
-        m_dataStorageTime = resp["storagetime"].toInt();
-    }
-    else if (cmd == "startsearch")
+        m_searchTimer->stop();
+        m_state = Ready;
+    });
+}
+
+void NeuroplayPro::handleListDevices(const QJsonObject &resp)
+{
+    QJsonArray arr = resp["devices"].toArray();
+    for (QJsonValueRef devjson: arr)
     {
-        for (NeuroplayDevice *dev: m_deviceList)
-            dev->m_isConnected = false;
-        m_searchTimer->start();
-        QTimer::singleShot(6000, [=]()
+        QJsonObject o = devjson.toObject();
+        QString name = o["name"].toString();
+        NeuroplayDevice *dev = nullptr;
+        if (!m_deviceMap.contains(name))
         {
-            m_searchTimer->stop();
-            m_state = Ready;
-        });
-    }
-    else if (cmd == "listdevices")
-    {
-        QJsonArray arr = resp["devices"].toArray();
-        for (QJsonValueRef devjson: arr)
+            dev = createDevice(o);
+        }
+        else
         {
-            QJsonObject o = devjson.toObject();
-            QString name = o["name"].toString();
-            NeuroplayDevice *dev = nullptr;
-            if (!m_deviceMap.contains(name))
-            {
-                dev = createDevice(o);
-            }
-            else
-            {
-                dev  = m_deviceMap[name];
-            }
-            dev->m_isConnected = true;
+            dev  = m_deviceMap[name];
         }
+        dev->m_isConnected = true;
     }
-    else if (cmd == "startdevice")
+    emit devicesListed();
+}
+
+void NeuroplayPro::handleStartDevice(const QJsonObject &resp)
+{
+    m_searchTimer->stop();
+    if (resp.contains("result") && !resp["result"].toBool())
     {
-        m_searchTimer->stop();
-        m_devStartTimer->start();
-        QTimer::singleShot(6000, [=](){m_devStartTimer->stop();});
+        failDeviceStart();
+        return;
     }
-    else if (cmd == "currentdeviceinfo")
+    m_devStartTimer->start();
+    m_devStartTimeout->start();
+}
+
+void NeuroplayPro::failDeviceStart()
+{
+    m_devStartTimer->stop();
+    m_devStartTimeout->stop();
+    NeuroplayDevice *dev = m_startingDevice;
+    m_startingDevice = nullptr;
+    qCDebug(lcNeuroplay) << "device start failed" << (dev? dev->name(): QString());
+    emit deviceStartFailed(dev);
+}
+
+void NeuroplayPro::handleCurrentDeviceInfo(const QJsonObject &resp)
+{
+    if (resp["result"].toBool())
     {
-        if (resp["result"].toBool())
+        QJsonObject o = resp["device"].toObject();
+        QString name = o["name"].toString();
+        if (!m_deviceMap.contains(name))
         {
-            m_devStartTimer->stop();
-            QJsonObject o = resp["device"].toObject();
-            QString name = o["name"].toString();
-            if (!m_deviceMap.contains(name))
-            {
-                createDevice(o);
-            }
-            m_currentDevice = m_deviceMap[name];
-            m_currentDevice->setStarted();
-            emit deviceReady(m_currentDevice);
+            createDevice(o);
         }
-        else if (m_state < Ready)
+        m_currentDevice = m_deviceMap[name];
+        // a device being started is polled for until it is the current one or the start times out
+        if (!m_startingDevice || m_startingDevice == m_currentDevice)
         {
-            send("startsearch");
+            m_devStartTimer->stop();
+            m_devStartTimeout->stop();
+            m_startingDevice = nullptr;
         }
+        // the server knows the mode best, e.g. when the device was started by another client
+        if (o.contains("channels"))
+            m_currentDevice->m_startedChannels = o["channels"].toInt();
+        m_currentDevice->setStarted();
+        emit deviceReady(m_currentDevice);
     }
-    else if (cmd == "enabledatagrabmode")
-    {
-        m_isDataGrab = true;
-    }
-    else if (cmd == "disabledatagrabmode")
+    else if (m_state < Ready)
     {
-        m_isDataGrab = false;
+        send("startsearch");
     }
+}
 
-//    emit response(text);
+void NeuroplayPro::handleEnableDataGrabMode(const QJsonObject &)
+{
+    m_isDataGrab = true;
+}
+
+void NeuroplayPro::handleDisableDataGrabMode(const QJsonObject &)
+{
+    m_isDataGrab = false;
 }
 
 void NeuroplayPro::setLPF(double value)
 {
     m_LPF = value;
-    send({{"command", "setLPF"}, {"value", m_LPF}});
+    send(CommandWriter("setLPF").add("value", m_LPF).toUtf8());
 }
 
 void NeuroplayPro::setHPF(double value)
 {
     m_HPF = value;
-    send({{"command", "setHPF"}, {"value", m_HPF}});
+    send(CommandWriter("setHPF").add("value", m_HPF).toUtf8());
 }
 
 void NeuroplayPro::setBSF(double value)
 {
     m_BSF = value;
-    send({{"command", "setBSF"}, {"value", m_BSF}});
+    send(CommandWriter("setBSF").add("value", m_BSF).toUtf8());
 }
 
 void NeuroplayPro::setFilters(double LPF, double HPF, double BSF)
@@ -650,7 +1431,7 @@ void NeuroplayPro::setDefaultFilters()
 void NeuroplayPro::setDataStorageTime(int seconds)
 {
     //! @bug "value" value expected as string instead of number!
-    send({{"command", "setdatastoragetime"}, {"value", QString::number(seconds)}});
+    send(CommandWriter("setdatastoragetime").add("value", QString::number(seconds)).toUtf8());
 }
 
 void NeuroplayPro::enableDataGrabMode()
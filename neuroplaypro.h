@@ -9,11 +9,27 @@
 #include <QTimer>
 #include <QVector>
 #include <QQueue>
+#include <QHash>
+#include <QThread>
+#include <QPointer>
+#include <QIODevice>
+#include "samplebuffer.h"
+#include "bandpower.h"
+#include "filterbank.h"
+#include "edfrecorder.h"
+#include "grabscheduler.h"
+#include "requestqueue.h"
+#include "sampleclock.h"
+#include "streamcontinuity.h"
+#include "socketworker.h"
+#include "metrics.h"
 
 class NeuroplayDevice : public QObject
 {
     Q_OBJECT
 public:
+    virtual ~NeuroplayDevice();
+
     int id() const {return m_id;}
     const QString &name() const {return m_name;}
     const QString &model() const {return m_model;}
@@ -38,9 +54,10 @@ public:
     typedef QVector< QVector<double> > ChannelsData;
     typedef QVector<Rhythms> ChannelsRhythms;
 
-    const ChannelsData &spectrum() const {return m_spectrum;}
+    // Converted from the last response when read, unless a slot is connected to spectrumReady() / rhythmsReady()
+    const ChannelsData &spectrum() const {decodeSpectrum(); return m_spectrum;}
     const QVector<double> &spectrumFrequencies() const {return m_spectrumFrequencies;}
-    const ChannelsRhythms &rhythms() const {return m_rhythms;}
+    const ChannelsRhythms &rhythms() const {decodeRhythms(); return m_rhythms;}
     double meditation() const {return m_meditation;}
     double concentration() const {return m_concentration;}
 
@@ -53,14 +70,90 @@ public:
     void grabMeditationHistory(bool enable = true);
     void grabConcentrationHistory(bool enable = true);
 
-    ChannelsData readFilteredDataHistory();
-    ChannelsData readRawDataHistory();
+    // Computes rhythms locally from the grabbed filtered samples instead of requesting them:
+    // every stepMs rhythms() is updated and rhythmsReady() emitted, and the power spectral density
+    // of the window goes to localSpectrum() with localSpectrumReady(). spectrum() stays the server's.
+    void computeRhythms(bool enable = true, int windowSize = 512, int stepMs = 100);
+    bool isComputingRhythms() const {return m_computeRhythms;}
+    const BandPowerEngine &bandPowerEngine() const {return m_bandPower;}
+    const ChannelsData &localSpectrum() const {return m_localSpectrum;}
+    const QVector<double> &localSpectrumFrequencies() const {return m_localSpectrumFrequencies;}
+
+    // Filters the grabbed raw samples locally (cutoffs in Hz, 0 disables a filter) instead of polling
+    // grabfiltereddata, so the filtered stream doesn't depend on the server's filter settings
+    void setLocalFilters(double LPF, double HPF, double BSF);
+    void disableLocalFilters();
+    bool hasLocalFilters() const {return m_localFiltering;}
+
+    // Additional filter configurations over the same raw stream, each with its own history.
+    // Adding one enables raw data grabbing; they are dropped by stop().
+    int addFilterBank(double LPF, double HPF, double BSF);
+    void removeFilterBanks();
+    int filterBankCount() const {return m_filterBanks.size();}
+    const SampleRingBuffer &filterBankBuffer(int index) const {return m_filterBanks[index].buffer;}
+    ChannelsData readFilterBankData(int index) {return m_filterBanks[index].buffer.read();}
+
+    // Streams the grabbed filtered (or raw) samples to an EDF file on a background thread.
+    // Unlike startRecord()/stopRecord(), the recording is never held in memory as a whole.
+    // physicalRange (uV) maps to the 16-bit EDF values, larger samples are clipped.
+    void startLocalRecord(const QString &fileName, bool raw = false, double physicalRange = 3276.7);
+    void stopLocalRecord();
+    bool isLocalRecording() const {return m_recorder != nullptr;}
+
+    // Host times of grabbed samples, see SampleClock: sample i of a read is at timeUs(i)
+    struct SampleTiming
+    {
+        qint64 firstSample;     // index in the stream since the device was started
+        double firstTimeUs;     // on SampleClock::nowUs()
+        double periodUs;
+
+        double timeUs(int i) const {return firstTimeUs + i * periodUs;}
+    };
+
+    ChannelsData readFilteredDataHistory(SampleTiming *timing = nullptr);
+    ChannelsData readRawDataHistory(SampleTiming *timing = nullptr);
+
+    // Zero-copy access to grabbed samples: look at buffer spans, then consume() the processed count
+    const SampleRingBuffer &filteredDataBuffer() const {return m_filteredDataBuffer;}
+    const SampleRingBuffer &rawDataBuffer() const {return m_rawDataBuffer;}
+    void consumeFilteredData(int count) {m_filteredDataBuffer.consume(count);}
+    void consumeRawData(int count) {m_rawDataBuffer.consume(count);}
+    // Sample rate of the grabbed streams, from the channel mode the device runs in
+    int sampleRate() const {return frequency(m_startedChannels? m_startedChannels: m_filteredDataBuffer.channels());}
+    // Timing of the oldest buffered sample, and the clocks with the drift against the host
+    SampleTiming filteredDataTiming() const {return sampleTiming(m_filteredDataBuffer, m_filteredClock);}
+    SampleTiming rawDataTiming() const {return sampleTiming(m_rawDataBuffer, m_rawClock);}
+    const SampleClock &filteredDataClock() const {return m_filteredClock;}
+    const SampleClock &rawDataClock() const {return m_rawClock;}
+
+    // Lost and repeated grabbed samples, see StreamContinuity: repeats are removed and gaps filled,
+    // so the buffers keep one sample per sample period; discontinuity() tells about each
+    const StreamContinuity::Stats &filteredDataContinuity() const {return m_filteredContinuity.stats();}
+    const StreamContinuity::Stats &rawDataContinuity() const {return m_rawContinuity.stats();}
+    // When samples are lost, halves the grab interval (down to MinAdaptiveGrabIntervalMs) and asks
+    // the server to keep samples twice as long as the longest time between polls seen.
+    // The storage time is a server setting, shared by all its clients: it is only ever raised,
+    // and stop() sets it back to the value before the first change. Off by default.
+    void setAdaptiveGrab(bool enable = true) {m_adaptiveGrab = enable;}
+    bool isAdaptiveGrab() const {return m_adaptiveGrab;}
+
     QVector<ChannelsRhythms> readRhythmsHistory();
     QVector<TimedValue> readMeditationHistory();
     QVector<TimedValue> readConcentrationHistory();
 
     void setGrabInterval(int value_ms);
     int grabInterval() const {return m_grabIntervalMs;}
+    // Achieved poll interval and latency of a grab stream
+    GrabScheduler::Stats grabStats(GrabScheduler::Stream stream) const {return m_grabScheduler->stats(stream);}
+
+    // How many seconds of grabbed samples are kept until read
+    static const int HistorySeconds = 10;
+    // Base64 characters of a record file decoded per step
+    static const int RecordChunkSize = 1 << 20;
+    // Upper frequency of the locally computed spectrum()
+    static const int LocalSpectrumMaxHz = 50;
+    static const int MinAdaptiveGrabIntervalMs = 20;
+    static const int MaxStorageTimeSeconds = 60;
 
 public slots:
     void start();
@@ -69,6 +162,11 @@ public slots:
 
     void startRecord() {request("startrecord");}
     void stopRecord() {request("stoprecord");}
+    // With sinks set, the stopRecord() files are decoded from the response frame in chunks straight
+    // into them (recordProgress() and recordSaved() are emitted) instead of coming with recordedData().
+    // If a file can't be decoded, recordFailed() is emitted instead of recordSaved()
+    void setRecordSinks(QIODevice *edf, QIODevice *npd = nullptr) {m_edfSink = edf; m_npdSink = npd;}
+    bool hasRecordSinks() const {return m_edfSink || m_npdSink;}
 
     void requestFilteredData()  {request("filtereddata");}
     void requestRawData()       {request("rawdata");}
@@ -90,14 +188,24 @@ signals:
     void ready();
 
     void filteredDataReceived(ChannelsData data);
+    // The newest count samples of filteredDataBuffer() have just been grabbed (or filtered locally)
+    void filteredSamplesAppended(int count);
     void rawDataReceived(ChannelsData data);
     void spectrumReady();
+    void localSpectrumReady();
     void rhythmsReady();
     void meditationReady();
     void concentrationReady();
     void bciReady();
 
     void recordedData(QByteArray edf, QByteArray npd);
+    void recordProgress(qint64 done, qint64 total);
+    void recordSaved(qint64 edfBytes, qint64 npdBytes);
+    void recordFailed(QString text);
+    void localRecordFinished(QString fileName, int seconds);
+    // The file could not be opened or written (e.g. the disk is full), localRecordFinished() won't follow
+    void localRecordFailed(QString text);
+    void discontinuity(bool filtered, int lost, int repeated);
 
 private:
     int m_id;
@@ -107,7 +215,9 @@ private:
     int m_maxChannels;
     int m_preferredChannelCount;
     QVector< QPair<int, int> > m_channelModes;
+    int m_startedChannels;  // channel count of the mode the device was started with, 0 if unknown
     friend class NeuroplayPro;
+    friend class SessionReplay;
     NeuroplayDevice(const QJsonObject &json);
 
     bool m_isConnected;
@@ -118,36 +228,119 @@ private:
     bool m_grabRhythms;
     bool m_grabMeditation;
     bool m_grabConcentration;
+    bool m_computeRhythms;
+    bool m_localFiltering;
 
     bool grab_mode_enabled = false;
 
     QVector<double> m_spectrumFrequencies;
-    ChannelsData m_spectrum;
-    ChannelsRhythms m_rhythms;
+    mutable ChannelsData m_spectrum;
+    mutable ChannelsRhythms m_rhythms;
+    // the undecoded last responses, a raw frame or a part of the parsed one
+    mutable QByteArray m_spectrumFrame;
+    mutable QJsonArray m_spectrumJson;
+    mutable QJsonArray m_rhythmsJson;
+    mutable bool m_spectrumPending;
+    mutable bool m_rhythmsPending;
+    ChannelsData m_localSpectrum;
+    QVector<double> m_localSpectrumFrequencies;
     double m_meditation;
     double m_concentration;
 
-    QQueue< QVector<double> > m_filteredDataBuffer;
-    QQueue< QVector<double> > m_rawDataBuffer;
-    QQueue<ChannelsRhythms> m_rhythmsBuffer;
+    SampleRingBuffer m_filteredDataBuffer;
+    SampleRingBuffer m_rawDataBuffer;
+    SampleClock m_filteredClock;
+    SampleClock m_rawClock;
+    StreamContinuity m_filteredContinuity;
+    StreamContinuity m_rawContinuity;
+    bool m_adaptiveGrab;
+    int m_serverStorageTime;    // last known, kept up to date by NeuroplayPro
+    int m_requestedStorageTime; // by adaptToGap(), 0 if not changed
+    int m_restoreStorageTime;   // the server's before the first change
+    BandPowerEngine m_bandPower;
+    int m_bandPowerWindow;
+    int m_bandPowerStepMs;
+    BiquadFilterBank m_localFilter;
+    typedef struct
+    {
+        BiquadFilterBank filter;
+        SampleRingBuffer buffer;
+    } FilterBank;
+    QVector<FilterBank> m_filterBanks;
+
+    EdfRecorder *m_recorder;
+    QThread *m_recorderThread;
+    QString m_recordFileName;
+    bool m_recordRaw;
+    bool m_recorderOpened;
+    double m_recordRange;
+
+    QPointer<QIODevice> m_edfSink;
+    QPointer<QIODevice> m_npdSink;
+    QQueue<QJsonArray> m_rhythmsBuffer;  // undecoded, see readRhythmsHistory()
     QQueue<TimedValue> m_meditationBuffer;
     QQueue<TimedValue> m_concentrationBuffer;
-    QTimer *m_grabTimer;
+    GrabScheduler *m_grabScheduler;
     int m_grabIntervalMs = 50;
 
     void setStarted(bool started = true);
 
-    void request(QString text);
-    void request(QJsonObject json);
+    void request(const char *text);
+    void request(const QByteArray &text);
 
     void switchGrabMode();
 
+    typedef void (NeuroplayDevice::*ResponseHandler)(const QJsonObject &resp);
+    static const QHash<QString, ResponseHandler> &responseHandlers();
+    static bool handlesResponse(const QString &cmd);
+
+    void handleLastSpectrum(const QJsonObject &resp);
+    void handleSpectrumFrequencies(const QJsonObject &resp);
+    void handleRhythms(const QJsonObject &resp);
+    void handleMeditation(const QJsonObject &resp);
+    void handleConcentration(const QJsonObject &resp);
+    void handleBCI(const QJsonObject &resp);
+    void handleEnableDataGrabMode(const QJsonObject &resp);
+    void handleDisableDataGrabMode(const QJsonObject &resp);
+    void handleFilteredData(const QJsonObject &resp);
+    void handleRawData(const QJsonObject &resp);
+    void handleGrabFilteredData(const QJsonObject &resp);
+    void handleGrabRawData(const QJsonObject &resp);
+    void handleRhythmsHistory(const QJsonObject &resp);
+    void handleMeditationHistory(const QJsonObject &resp);
+    void handleConcentrationHistory(const QJsonObject &resp);
+    void handleStopRecord(const QJsonObject &resp);
+
+    bool hasSubscriber(void (NeuroplayDevice::*signal)()) const;
+    bool deferFrame(const QString &cmd, const QByteArray &frame);
+    void decodeSpectrum() const;
+    void decodeRhythms() const;
+    void closeRecorder();
+    static ChannelsRhythms rhythmsFromJson(const QJsonArray &arr);
+
+    int historyCapacity() const;
+    int frequency(int channels) const;
+    void processFilteredData(int count);
+    void processRawData(int count);
+    void recordSamples(const SampleRingBuffer &buffer, int count);
+    // Runs the local processing for samples just appended to the filtered or raw buffer
+    void samplesAppended(bool filtered, int count);
+    int appendGrabbedData(SampleRingBuffer &buffer, const QJsonArray &arr);
+    void stampSamples(bool filtered, int count, qint64 arrivalUs);
+    int checkGrabbedSamples(bool filtered, int count, qint64 arrivalUs);
+    void adaptToGap(qint64 intervalUs);
+    void restoreStorageTime();
+    static SampleTiming sampleTiming(const SampleRingBuffer &buffer, const SampleClock &clock);
+
 signals: // private
-    void doRequest(QString text);
+    void doRequest(QByteArray text);
 
 private slots:
     void onResponse(QJsonObject resp);
-    void grabRequest();
+    void onGrabFrame(QString cmd, QByteArray frame);
+    bool onRecordFrame(const QByteArray &frame);
+    void onSampleBlock(const QString &cmd, const ChannelsData &data, qint64 arrivalUs);
+    void grabRequest(int stream);
 };
 
 
@@ -162,6 +355,22 @@ public:
 
     explicit NeuroplayPro(QObject *parent = nullptr);
     virtual ~NeuroplayPro();
+
+    // Moves the socket I/O and response parsing to a dedicated thread, so big frames
+    // don't stall the GUI. Call before open(); stays in effect for the object's lifetime.
+    // All signals are still emitted in the thread of this object.
+    void enableWorkerThread();
+    bool isWorkerThreadEnabled() const {return m_thread != nullptr;}
+
+    // Replaces the WebSocket to NeuroPlayPro (ws://localhost:1336) with another transport, e.g.
+    // WebSocketTransport in Binary mode, InProcessTransport or ReplayTransport. Takes ownership
+    // of the parentless transport; call before open().
+    void setTransport(Transport *transport);
+
+    // Records all WebSocket traffic with timestamps into a binary capture file,
+    // which FrameCaptureReader can seek and replay into another NeuroplayPro
+    void startCapture(const QString &fileName);
+    void stopCapture();
     State state() const {return m_state;}
     bool isConnected() const {return m_state >= Connected;}
     bool isDataGrabMode() const {return m_isDataGrab;}
@@ -172,6 +381,11 @@ public:
     QString favoriteDeviceName() const {return m_favoriteDeviceName;}
     QString version() {return m_version;}
 
+    // How many response deliveries were avoided by routing instead of broadcasting to every device
+    quint64 savedDispatches() const {return m_savedDispatches;}
+    // Outgoing requests: queued, in flight, deduplicated and timed out counts
+    const RequestQueue &requestQueue() const {return m_requests;}
+
     double LPF() const {return m_LPF;}
     void setLPF(double value);
     double HPF() const {return m_HPF;}
@@ -196,14 +410,24 @@ signals:
     void disconnected();
     void error(QString text);
     void deviceConnected(NeuroplayDevice *device);
+    // A listdevices response has been handled, device(i) has the devices found so far
+    void devicesListed();
     void deviceReady(NeuroplayDevice *device);
+    // The server refused to start the device, or it did not become current in time; device is null if unknown
+    void deviceStartFailed(NeuroplayDevice *device);
 
 protected slots:
+    void send(const char *cmd);
+    // Polls are dropped while an identical one is pending, see RequestQueue
+    void send(const QByteArray &cmd, bool deduplicate = true);
+
 public slots:
+    // Always sent, also when the same command is still waiting for its response
     void send(QString cmd);
 
 private:
-    QWebSocket *socket;
+    SocketWorker *m_socket;
+    QThread *m_thread;
     State m_state;
     bool m_isDataGrab;
     QMap<QString, QString> m_commands;
@@ -211,22 +435,53 @@ private:
     QMap<QString, NeuroplayDevice*> m_deviceMap;
     QTimer *m_searchTimer;
     QTimer *m_devStartTimer;
+    QTimer *m_devStartTimeout;
+    QPointer<NeuroplayDevice> m_startingDevice;
     NeuroplayDevice *m_currentDevice;
+    NeuroplayDevice *m_lastRequester;
+    quint64 m_savedDispatches;
+    RequestQueue m_requests;
+    QHash<QString, MetricsCounter*> m_frameCounters;
+    bool m_flushScheduled;
     QString m_favoriteDeviceName;
     double m_LPF, m_HPF, m_BSF;
     int m_dataStorageTime;
     QString m_version;
 
-    void send(QJsonObject obj);
     friend class NeuroplayDevice;
 
     NeuroplayDevice *createDevice(const QJsonObject &o);
 
+    typedef void (NeuroplayPro::*ResponseHandler)(const QJsonObject &resp);
+    static const QHash<QString, ResponseHandler> &responseHandlers();
+    void respond(const QString &cmd);
+    NeuroplayDevice *responseTarget() const;
+    void countDispatches(int delivered);
+
+    void handleHelp(const QJsonObject &resp);
+    void handleVersion(const QJsonObject &resp);
+    void handleFavoriteDeviceName(const QJsonObject &resp);
+    void handleFilters(const QJsonObject &resp);
+    void handleDataStorageTime(const QJsonObject &resp);
+    void handleStartSearch(const QJsonObject &resp);
+    void handleListDevices(const QJsonObject &resp);
+    void handleStartDevice(const QJsonObject &resp);
+    void handleCurrentDeviceInfo(const QJsonObject &resp);
+    void handleEnableDataGrabMode(const QJsonObject &resp);
+    void handleDisableDataGrabMode(const QJsonObject &resp);
+
 private slots:
     void onSocketResponse(const QString &text);
+    void onSocketFrame(const QByteArray &frame);
+    void onResponse(const QJsonObject &resp);
+    void onSamplesReceived();
+    void onDeviceRequest(QByteArray cmd);
+    void flushRequests();
+    void failDeviceStart();
 
 signals:
     void responseJson(QJsonObject json);
+    void sendFrame(const QByteArray &text);
 
 };
 
@@ -0,0 +1,54 @@
+# SDK sources, shared by the example application, the benchmarks and the tools
+
+QT += concurrent network
+
+INCLUDEPATH += $$PWD
+
+# The BandPowerEngine kernels are plain loops left to the auto-vectorizer,
+# which GCC before 12 only runs at -O3; clang and MSVC run it at -O2 already
+gcc:!clang: QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
+
+SOURCES += \
+    $$PWD/bandpower.cpp \
+    $$PWD/base64decoder.cpp \
+    $$PWD/chart.cpp \
+    $$PWD/commandwriter.cpp \
+    $$PWD/edfrecorder.cpp \
+    $$PWD/filterbank.cpp \
+    $$PWD/framecapture.cpp \
+    $$PWD/grabdecoder.cpp \
+    $$PWD/grabscheduler.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/multidevicesession.cpp \
+    $$PWD/neuroplaylog.cpp \
+    $$PWD/neuroplaypro.cpp \
+    $$PWD/requestqueue.cpp \
+    $$PWD/samplebuffer.cpp \
+    $$PWD/sampleclock.cpp \
+    $$PWD/sessionreplay.cpp \
+    $$PWD/socketworker.cpp \
+    $$PWD/streamcontinuity.cpp \
+    $$PWD/transport.cpp
+
+HEADERS += \
+    $$PWD/bandpower.h \
+    $$PWD/base64decoder.h \
+    $$PWD/chart.h \
+    $$PWD/commandwriter.h \
+    $$PWD/edfrecorder.h \
+    $$PWD/filterbank.h \
+    $$PWD/framecapture.h \
+    $$PWD/grabdecoder.h \
+    $$PWD/grabscheduler.h \
+    $$PWD/metrics.h \
+    $$PWD/multidevicesession.h \
+    $$PWD/neuroplaylog.h \
+    $$PWD/neuroplaypro.h \
+    $$PWD/requestqueue.h \
+    $$PWD/samplebuffer.h \
+    $$PWD/sampleclock.h \
+    $$PWD/sessionreplay.h \
+    $$PWD/socketworker.h \
+    $$PWD/spscqueue.h \
+    $$PWD/streamcontinuity.h \
+    $$PWD/transport.h
@@ -0,0 +1,129 @@
+#include "requestqueue.h"
+#include "grabdecoder.h"
+#include <QSet>
+
+RequestQueue::RequestQueue() :
+    m_nextId(1),
+    m_sent(0), m_deduplicated(0), m_timedOut(0)
+{
+}
+
+quint32 RequestQueue::enqueue(const QByteArray &text, bool deduplicate)
+{
+    // a lost response must not keep deduplicating the retries
+    expire();
+
+    Request r;
+    r.text = text;
+    r.response = responseOf(commandOf(text));
+    r.queuedTime = clock();
+    r.sentTime = 0;
+
+    if (deduplicate && isPoll(r.response))
+    {
+        for (const Request &q: m_queued)
+        {
+            if (q.text == text)
+            {
+                m_deduplicated++;
+                return 0;
+            }
+        }
+        for (const Request &q: m_inFlight)
+        {
+            if (q.text == text)
+            {
+                m_deduplicated++;
+                return 0;
+            }
+        }
+    }
+
+    r.id = m_nextId++;
+    if (!m_nextId)
+        m_nextId = 1;
+    m_queued << r;
+    return r.id;
+}
+
+QList<RequestQueue::Request> RequestQueue::takeQueued()
+{
+    QList<Request> result;
+    result.swap(m_queued);
+    qint64 now = clock();
+    for (Request &r: result)
+    {
+        r.sentTime = now;
+        m_inFlight << r;
+    }
+    m_sent += quint64(result.size());
+    return result;
+}
+
+qint64 RequestQueue::respond(const QString &responseCmd)
+{
+    for (int i=0; i<m_inFlight.size(); i++)
+    {
+        if (m_inFlight[i].response == responseCmd)
+        {
+            qint64 rtt = clock() - m_inFlight[i].sentTime;
+            m_inFlight.removeAt(i);
+            return rtt;
+        }
+    }
+    return -1;
+}
+
+int RequestQueue::expire()
+{
+    qint64 now = clock();
+    int count = 0;
+    while (!m_inFlight.isEmpty() && isExpired(m_inFlight.first().queuedTime, now))
+    {
+        m_inFlight.removeFirst();
+        count++;
+    }
+    m_timedOut += quint64(count);
+    return count;
+}
+
+void RequestQueue::clear()
+{
+    m_queued.clear();
+    m_inFlight.clear();
+}
+
+qint64 RequestQueue::clock()
+{
+    static const QElapsedTimer timer = []{QElapsedTimer t; t.start(); return t;}();
+    return timer.elapsed();
+}
+
+QString RequestQueue::commandOf(const QByteArray &text)
+{
+    QByteArray trimmed = text.trimmed();
+    if (trimmed.startsWith('{'))
+        return GrabDecoder::peekCommand(trimmed);
+    return QString::fromUtf8(trimmed);
+}
+
+QString RequestQueue::responseOf(const QString &command)
+{
+    QString cmd = command.toLower();
+    // grab commands are answered under different names
+    if (cmd == "grabrawdata")
+        return "grabfiltereddata";
+    if (cmd == "graboriginaldata")
+        return "grabrawdata";
+    return cmd;
+}
+
+bool RequestQueue::isPoll(const QString &command)
+{
+    // repeated on timers, a duplicate would only fetch the same data twice
+    static const QSet<QString> polls = {
+        "grabfiltereddata", "grabrawdata", "rhythmshistory", "meditationhistory", "concentrationhistory",
+        "lastspectrum"
+    };
+    return polls.contains(command);
+}
@@ -0,0 +1,67 @@
+#ifndef REQUESTQUEUE_H
+#define REQUESTQUEUE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QElapsedTimer>
+
+// Outgoing request bookkeeping for NeuroplayPro.
+// Requests are queued and flushed together once per event loop iteration,
+// every sent request gets an id and stays in flight until its response arrives or it times out.
+// The server does not echo ids, so responses are matched to the oldest in-flight request of that command.
+// Polls of the scheduler and the devices (grabs, histories, lastspectrum) are not queued again
+// while an identical one is queued or in flight; other requests, e.g. typed by the user, always go out.
+// Timeouts are counted from the enqueue time on the shared clock(), callers that retry on their own
+// (GrabScheduler) use the same clock and isExpired(), so a retry always finds the old request expired.
+class RequestQueue
+{
+public:
+    typedef struct
+    {
+        quint32 id;
+        QByteArray text;
+        QString response;   // command name of the expected response
+        qint64 queuedTime;
+        qint64 sentTime;
+    } Request;
+
+    RequestQueue();
+
+    // Expires stale requests first, then returns the request id, or 0 if deduplicate is set
+    // and the request is a duplicate of a pending poll
+    quint32 enqueue(const QByteArray &text, bool deduplicate = true);
+    // Takes all queued requests for sending, they become in flight
+    QList<Request> takeQueued();
+    // Returns the round trip time in ms, or -1 if no request was waiting for this response
+    qint64 respond(const QString &responseCmd);
+    // Drops in-flight requests queued RequestTimeoutMs or more ago, returns their count
+    int expire();
+    void clear();
+
+    int queuedCount() const {return m_queued.size();}
+    int inFlightCount() const {return m_inFlight.size();}
+    quint64 sentCount() const {return m_sent;}
+    quint64 deduplicatedCount() const {return m_deduplicated;}
+    quint64 timedOutCount() const {return m_timedOut;}
+
+    static QString commandOf(const QByteArray &text);
+    static QString responseOf(const QString &command);
+    static bool isPoll(const QString &command);
+
+    // Monotonic ms clock shared by all queues and schedulers
+    static qint64 clock();
+    static bool isExpired(qint64 requestTime, qint64 now) {return now - requestTime >= RequestTimeoutMs;}
+
+    static const int RequestTimeoutMs = 2000;
+
+private:
+    QList<Request> m_queued;
+    QList<Request> m_inFlight;
+    quint32 m_nextId;
+    quint64 m_sent;
+    quint64 m_deduplicated;
+    quint64 m_timedOut;
+};
+
+#endif // REQUESTQUEUE_H
@@ -0,0 +1,145 @@
+#include "samplebuffer.h"
+#include <cstring>
+
+SampleRingBuffer::SampleRingBuffer() :
+    m_channels(0), m_capacity(1), m_head(0), m_size(0)
+{
+}
+
+SampleRingBuffer::SampleRingBuffer(int channels, int capacity) :
+    SampleRingBuffer()
+{
+    reset(channels, capacity);
+}
+
+void SampleRingBuffer::reset(int channels, int capacity)
+{
+    m_channels = qMax(channels, 0);
+    m_capacity = qMax(capacity, 1);
+    m_data.fill(0, m_channels * m_capacity);
+    m_head = 0;
+    m_size = 0;
+}
+
+void SampleRingBuffer::clear()
+{
+    m_head = 0;
+    m_size = 0;
+}
+
+SampleRingBuffer::Writer SampleRingBuffer::writer(int channel)
+{
+    double *begin = m_data.data() + channel * m_capacity;
+    return Writer(begin, begin + m_capacity, begin + tail());
+}
+
+void SampleRingBuffer::commit(int count)
+{
+    if (count <= 0)
+        return;
+    int total = m_size + count;
+    if (total > m_capacity)
+    {
+        // the writers have wrapped over the oldest samples
+        m_head = (m_head + total - m_capacity) % m_capacity;
+        m_size = m_capacity;
+    }
+    else
+    {
+        m_size = total;
+    }
+}
+
+void SampleRingBuffer::append(const QVector< QVector<double> > &data)
+{
+    int chnum = qMin(data.size(), m_channels);
+    int count = data.isEmpty()? 0: data[0].size();
+    for (int j=0; j<chnum; j++)
+    {
+        Writer w = writer(j);
+        const QVector<double> &src = data[j];
+        int n = qMin(count, src.size());
+        for (int i=0; i<n; i++)
+            w.put(src[i]);
+        for (int i=n; i<count; i++)
+            w.put(0);
+    }
+    commit(count);
+}
+
+SampleRingBuffer::Span SampleRingBuffer::span(int channel, int maxCount) const
+{
+    int count = (maxCount < 0)? m_size: qMin(maxCount, m_size);
+    const double *column = m_data.constData() + channel * m_capacity;
+    Span s;
+    s.first = column + m_head;
+    s.firstSize = qMin(count, m_capacity - m_head);
+    s.second = column;
+    s.secondSize = count - s.firstSize;
+    return s;
+}
+
+void SampleRingBuffer::consume(int count)
+{
+    count = qBound(0, count, m_size);
+    m_head = (m_head + count) % m_capacity;
+    m_size -= count;
+}
+
+void SampleRingBuffer::insertBeforeNewest(int newest, int count)
+{
+    newest = qBound(0, newest, m_size);
+    count = qBound(0, count, m_capacity - newest);
+    if (!count)
+        return;
+    int from = tail() - newest + m_capacity;   // the first of the newest, unwrapped
+    for (int j=0; j<m_channels; j++)
+    {
+        double *column = m_data.data() + j * m_capacity;
+        int held = (m_size > newest)? from - 1: from;
+        double value = column[held % m_capacity];
+        // moved from the end, the regions may overlap
+        for (int i=newest-1; i>=0; i--)
+            column[(from + count + i) % m_capacity] = column[(from + i) % m_capacity];
+        for (int i=0; i<count; i++)
+            column[(from + i) % m_capacity] = value;
+    }
+    commit(count);
+}
+
+void SampleRingBuffer::removeBeforeNewest(int newest, int count)
+{
+    newest = qBound(0, newest, m_size);
+    count = qBound(0, count, m_size - newest);
+    if (!count)
+        return;
+    int from = tail() - newest + m_capacity;
+    for (int j=0; j<m_channels; j++)
+    {
+        double *column = m_data.data() + j * m_capacity;
+        for (int i=0; i<newest; i++)
+            column[(from - count + i) % m_capacity] = column[(from + i) % m_capacity];
+    }
+    m_size -= count;
+}
+
+QVector< QVector<double> > SampleRingBuffer::read(int maxCount)
+{
+    QVector< QVector<double> > result;
+    int count = (maxCount < 0)? m_size: qMin(maxCount, m_size);
+    if (!count)
+        return result;
+
+    result.resize(m_channels);
+    for (int j=0; j<m_channels; j++)
+    {
+        Span s = span(j, count);
+        QVector<double> &dst = result[j];
+        dst.resize(count);
+        memcpy(dst.data(), s.first, s.firstSize * sizeof(double));
+        if (s.secondSize)
+            memcpy(dst.data() + s.firstSize, s.second, s.secondSize * sizeof(double));
+    }
+    consume(count);
+    return result;
+}
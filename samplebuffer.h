@@ -0,0 +1,78 @@
+#ifndef SAMPLEBUFFER_H
+#define SAMPLEBUFFER_H
+
+#include <QVector>
+
+// Fixed-capacity ring buffer for multichannel samples.
+// Storage is channel-major: each channel owns a contiguous column of capacity() values,
+// so appending a block and reading history are plain sequential copies per channel.
+// When the buffer is full, the oldest samples are overwritten.
+class SampleRingBuffer
+{
+public:
+    SampleRingBuffer();
+    SampleRingBuffer(int channels, int capacity);
+
+    void reset(int channels, int capacity);
+    void clear();
+
+    int channels() const {return m_channels;}
+    int capacity() const {return m_capacity;}
+    int size() const {return m_size;}
+    bool isEmpty() const {return m_size == 0;}
+
+    // Sequential writer for one channel, starting right after the newest sample.
+    // Values are not visible to readers until commit() is called.
+    class Writer
+    {
+    public:
+        void put(double value)
+        {
+            *m_pos = value;
+            if (++m_pos == m_end)
+                m_pos = m_begin;
+        }
+    private:
+        friend class SampleRingBuffer;
+        Writer(double *begin, double *end, double *pos) : m_begin(begin), m_end(end), m_pos(pos) {}
+        double *m_begin, *m_end, *m_pos;
+    };
+    Writer writer(int channel);
+    void commit(int count);
+
+    void append(const QVector< QVector<double> > &data);
+
+    // View over the oldest samples of one channel, split in two parts where the ring wraps.
+    // It stays valid until the next commit() or consume().
+    struct Span
+    {
+        const double *first;
+        int firstSize;
+        const double *second;
+        int secondSize;
+
+        int size() const {return firstSize + secondSize;}
+        double operator[](int i) const {return (i < firstSize)? first[i]: second[i - firstSize];}
+    };
+    Span span(int channel, int maxCount = -1) const;
+    void consume(int count);
+
+    // Stream repairs just before the newest samples: inserting repeats the sample before them
+    // (the oldest samples are dropped when full), removing closes up the buffer
+    void insertBeforeNewest(int newest, int count);
+    void removeBeforeNewest(int newest, int count);
+
+    // Copies up to maxCount oldest samples (all if maxCount < 0) and removes them from the buffer
+    QVector< QVector<double> > read(int maxCount = -1);
+
+private:
+    QVector<double> m_data;
+    int m_channels;
+    int m_capacity;
+    int m_head;     // index of the oldest sample
+    int m_size;
+
+    int tail() const {return (m_head + m_size) % m_capacity;}
+};
+
+#endif // SAMPLEBUFFER_H
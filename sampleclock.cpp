@@ -0,0 +1,95 @@
+#include "sampleclock.h"
+#include <QElapsedTimer>
+
+SampleClock::SampleClock() :
+    m_sampleRate(0),
+    m_nominalPeriodUs(0),
+    m_periodUs(0),
+    m_offsetUs(0),
+    m_total(0),
+    m_lastArrivalUs(0),
+    m_currentInterval(-1)
+{
+}
+
+void SampleClock::reset(int sampleRate)
+{
+    m_sampleRate = qMax(sampleRate, 0);
+    m_nominalPeriodUs = m_sampleRate? 1e6 / m_sampleRate: 0;
+    m_periodUs = m_nominalPeriodUs;
+    m_offsetUs = 0;
+    m_total = 0;
+    m_lastArrivalUs = 0;
+    m_points.clear();
+    m_currentInterval = -1;
+}
+
+void SampleClock::addBlock(int count, qint64 arrivalUs)
+{
+    if (count <= 0 || !m_sampleRate)
+        return;
+    m_total += count;
+    m_lastArrivalUs = arrivalUs;
+
+    // the block's last sample is the one that was taken right before it was sent
+    Point p;
+    p.index = m_total - 1;
+    p.arrivalUs = arrivalUs;
+    qint64 interval = p.index / (qint64(m_sampleRate) * EnvelopeSeconds);
+    if (interval != m_currentInterval)
+    {
+        if (m_currentInterval >= 0)
+        {
+            m_points << m_current;
+            if (m_points.size() > EnvelopePoints)
+                m_points.remove(0);
+            fit();
+        }
+        m_currentInterval = interval;
+        m_current = p;
+    }
+    else if (p.arrivalUs - p.index * m_nominalPeriodUs < m_current.arrivalUs - m_current.index * m_nominalPeriodUs)
+    {
+        m_current = p;
+    }
+
+    double offset = p.arrivalUs - p.index * m_periodUs;
+    if (m_total == count || offset < m_offsetUs)
+        m_offsetUs = offset;
+}
+
+void SampleClock::fit()
+{
+    int n = m_points.size();
+    if (n >= 2)
+    {
+        // relative to the oldest point, so the sums keep their precision
+        double x0 = m_points[0].index, y0 = m_points[0].arrivalUs;
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (const Point &p: m_points)
+        {
+            double x = p.index - x0, y = p.arrivalUs - y0;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        double den = n * sxx - sx * sx;
+        if (den > 0)
+        {
+            double maxDrift = m_nominalPeriodUs * MaxDriftPpm / 1e6;
+            double period = (n * sxy - sx * sy) / den;
+            m_periodUs = qBound(m_nominalPeriodUs - maxDrift, period, m_nominalPeriodUs + maxDrift);
+        }
+    }
+
+    m_offsetUs = m_points[0].arrivalUs - m_points[0].index * m_periodUs;
+    for (const Point &p: m_points)
+        m_offsetUs = qMin(m_offsetUs, p.arrivalUs - p.index * m_periodUs);
+}
+
+qint64 SampleClock::nowUs()
+{
+    static QElapsedTimer clock = []() {QElapsedTimer t; t.start(); return t;}();
+    return clock.nsecsElapsed() / 1000;
+}
@@ -0,0 +1,69 @@
+#ifndef SAMPLECLOCK_H
+#define SAMPLECLOCK_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// Time base of a grabbed sample stream on the host's monotonic clock (nowUs()).
+// Every block is stamped when it arrives. A block can only arrive after its last sample was
+// taken, so the arrivals bound the sample times from above and the earliest ones show the
+// sample clock best. The clock fits
+//   timeUs(k) = offset + k * period
+// to the lower envelope of the arrivals: the earliest arrival (against the nominal period) of
+// every EnvelopeSeconds of samples is kept, a least-squares line through the last EnvelopePoints
+// of them gives the period the device really samples at as seen by the host (the drift between
+// the two clocks), and the line is then lowered under all arrivals.
+// The times include the smallest transport delay, which can't be told from the arrivals.
+class SampleClock
+{
+public:
+    SampleClock();
+
+    // Starts a new stream; the sample indices count from 0 again
+    void reset(int sampleRate);
+    void addBlock(int count, qint64 arrivalUs);
+
+    int sampleRate() const {return m_sampleRate;}
+    qint64 sampleCount() const {return m_total;}
+    bool isValid() const {return m_total > 0;}
+
+    // Host time of a sample of the stream
+    double timeUs(qint64 index) const {return m_offsetUs + index * m_periodUs;}
+    double periodUs() const {return m_periodUs;}
+    // Rate of the device's sample clock against the host's, in parts per million: positive
+    // when the device samples slower than its nominal rate in host time
+    double driftPpm() const {return m_nominalPeriodUs > 0? (m_periodUs / m_nominalPeriodUs - 1) * 1e6: 0;}
+    // How late the newest block arrived after its last sample
+    double lastDelayUs() const {return isValid()? m_lastArrivalUs - timeUs(m_total - 1): 0;}
+    qint64 lastArrivalUs() const {return m_lastArrivalUs;}
+
+    // Monotonic host time, shared by all clocks, e.g. to stamp stimulus events
+    static qint64 nowUs();
+
+    static const int EnvelopeSeconds = 1;
+    static const int EnvelopePoints = 60;
+    // Fitted periods further than that from the nominal one are taken as noise
+    static const int MaxDriftPpm = 2000;
+
+private:
+    typedef struct
+    {
+        qint64 index;
+        qint64 arrivalUs;
+    } Point;
+
+    int m_sampleRate;
+    double m_nominalPeriodUs;
+    double m_periodUs;
+    double m_offsetUs;
+    qint64 m_total;
+    qint64 m_lastArrivalUs;
+
+    QVector<Point> m_points;    // envelope minima, oldest first
+    Point m_current;            // earliest arrival of the current envelope interval
+    qint64 m_currentInterval;
+
+    void fit();
+};
+
+#endif // SAMPLECLOCK_H
@@ -0,0 +1,227 @@
+#include "sessionreplay.h"
+#include <QFileInfo>
+#include <QtEndian>
+
+namespace
+{
+
+QByteArray headerField(const uchar *data, int offset, int width)
+{
+    return QByteArray(reinterpret_cast<const char *>(data) + offset, width).trimmed();
+}
+
+} // namespace
+
+SessionReplay::SessionReplay(QObject *parent) : QObject(parent),
+    m_data(nullptr),
+    m_device(nullptr),
+    m_headerBytes(0),
+    m_recordSamples(0),
+    m_samplesPerRecord(0),
+    m_records(0),
+    m_sampleRate(0),
+    m_position(0),
+    m_speed(1),
+    m_blockSize(25),
+    m_raw(false),
+    m_clockStart(0)
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &SessionReplay::onTick);
+}
+
+SessionReplay::~SessionReplay()
+{
+    close();
+}
+
+bool SessionReplay::open(const QString &fileName)
+{
+    close();
+    m_error.clear();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return fail(m_file.errorString());
+    qint64 fileSize = m_file.size();
+    if (fileSize < 256)
+        return fail("not an EDF file");
+    m_data = m_file.map(0, fileSize);
+    if (!m_data)
+        return fail(m_file.errorString());
+
+    m_headerBytes = headerField(m_data, 184, 8).toInt();
+    double duration = headerField(m_data, 244, 8).toDouble();
+    int ns = headerField(m_data, 252, 4).toInt();
+    if (ns <= 0 || m_headerBytes != 256 + 256 * ns || m_headerBytes > fileSize || duration <= 0)
+        return fail("not an EDF file");
+
+    // signal header fields are stored field by field for all signals
+    int labels = 256;
+    int physMin = labels + ns * (16 + 80 + 8);
+    int physMax = physMin + ns * 8;
+    int digMin = physMax + ns * 8;
+    int digMax = digMin + ns * 8;
+    int samples = digMax + ns * (8 + 80);
+
+    m_recordSamples = 0;
+    m_samplesPerRecord = 0;
+    for (int i=0; i<ns; i++)
+    {
+        int count = headerField(m_data, samples + i * 8, 8).toInt();
+        if (headerField(m_data, labels + i * 16, 16) != "EDF Annotations")
+        {
+            if (m_samplesPerRecord && count != m_samplesPerRecord)
+                return fail("signals with different sample rates are not supported");
+            m_samplesPerRecord = count;
+
+            double pmin = headerField(m_data, physMin + i * 8, 8).toDouble();
+            double pmax = headerField(m_data, physMax + i * 8, 8).toDouble();
+            double dmin = headerField(m_data, digMin + i * 8, 8).toDouble();
+            double dmax = headerField(m_data, digMax + i * 8, 8).toDouble();
+            Channel ch;
+            ch.offset = m_recordSamples;
+            ch.scale = (dmax != dmin)? (pmax - pmin) / (dmax - dmin): 1;
+            ch.shift = pmin - dmin * ch.scale;
+            m_channels << ch;
+        }
+        m_recordSamples += count;
+    }
+    if (m_channels.isEmpty() || m_samplesPerRecord <= 0)
+        return fail("no signals in the file");
+
+    // an unfinished recording has -1 records in the header
+    qint64 available = (fileSize - m_headerBytes) / (qint64(m_recordSamples) * 2);
+    m_records = headerField(m_data, 236, 8).toLongLong();
+    if (m_records < 0 || m_records > available)
+        m_records = available;
+    m_sampleRate = qRound(m_samplesPerRecord / duration);
+    m_position = 0;
+
+    QJsonObject mode;
+    mode["channels"] = channels();
+    mode["frequency"] = m_sampleRate;
+    QJsonObject json;
+    json["name"] = QFileInfo(fileName).completeBaseName();
+    json["model"] = "Replay";
+    json["serialNumber"] = fileName;
+    json["maxChannels"] = channels();
+    json["preferredChannelCount"] = channels();
+    json["channelModes"] = QJsonArray{mode};
+    // started by the first feed(), when the caller had a chance to connect to ready()
+    m_device = new NeuroplayDevice(json);
+    return true;
+}
+
+void SessionReplay::close()
+{
+    stop();
+    delete m_device;
+    m_device = nullptr;
+    if (m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+    m_data = nullptr;
+    m_file.close();
+    m_channels.clear();
+    m_records = 0;
+    m_position = 0;
+}
+
+void SessionReplay::seek(qint64 sample)
+{
+    m_position = qBound(qint64(0), sample, sampleCount());
+    m_clockStart = m_position;
+    m_clock.restart();
+}
+
+void SessionReplay::setSpeed(double speed)
+{
+    m_speed = qMax(speed, 0.0);
+    m_clockStart = m_position;
+    m_clock.restart();
+    m_timer->setInterval(m_speed > 0? 10: 0);
+}
+
+int SessionReplay::feed(int count)
+{
+    if (!isOpen())
+        return 0;
+    int n = int(qMin(qint64(qMax(count, 0)), sampleCount() - m_position));
+    if (!n)
+        return 0;
+
+    if (!m_device->isStarted())
+        m_device->setStarted();
+    SampleRingBuffer &buffer = m_raw? m_device->m_rawDataBuffer: m_device->m_filteredDataBuffer;
+    if (buffer.channels() != channels())
+        buffer.reset(channels(), m_device->historyCapacity());
+
+    const uchar *records = m_data + m_headerBytes;
+    int done = 0;
+    while (done < n)
+    {
+        qint64 pos = m_position + done;
+        qint64 record = pos / m_samplesPerRecord;
+        int first = int(pos % m_samplesPerRecord);
+        int k = qMin(n - done, m_samplesPerRecord - first);
+        const uchar *rec = records + record * m_recordSamples * 2;
+        for (int j=0; j<channels(); j++)
+        {
+            const Channel &ch = m_channels[j];
+            const uchar *src = rec + (ch.offset + first) * 2;
+            SampleRingBuffer::Writer w = buffer.writer(j);
+            for (int i=0; i<k; i++)
+                w.put(qFromLittleEndian<qint16>(src + i * 2) * ch.scale + ch.shift);
+        }
+        buffer.commit(k);
+        done += k;
+    }
+    m_position += n;
+    m_device->samplesAppended(!m_raw, n);
+    return n;
+}
+
+void SessionReplay::start()
+{
+    if (!isOpen())
+        return;
+    m_clockStart = m_position;
+    m_clock.start();
+    m_timer->start(m_speed > 0? 10: 0);
+}
+
+void SessionReplay::stop()
+{
+    m_timer->stop();
+}
+
+bool SessionReplay::fail(const QString &text)
+{
+    m_error = text;
+    close();
+    return false;
+}
+
+void SessionReplay::onTick()
+{
+    if (m_speed <= 0)
+    {
+        QElapsedTimer slice;
+        slice.start();
+        while (m_position < sampleCount() && slice.elapsed() < MaxSpeedSliceMs)
+            feed(m_blockSize);
+    }
+    else
+    {
+        qint64 target = m_clockStart + qint64(m_clock.elapsed() * m_sampleRate * m_speed / 1000);
+        target = qMin(target, sampleCount());
+        while (target - m_position >= m_blockSize || (target == sampleCount() && m_position < target))
+            feed(m_blockSize);
+    }
+
+    if (m_position >= sampleCount())
+    {
+        stop();
+        emit finished();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef SESSIONREPLAY_H
+#define SESSIONREPLAY_H
+
+#include <QObject>
+#include <QFile>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "neuroplaypro.h"
+
+// Replays a recorded EDF session (e.g. one written by startLocalRecord()) through a NeuroplayDevice,
+// without a server: the file is memory-mapped and its samples are written straight into the device
+// buffers, so readFilteredDataHistory(), local rhythms/spectrum, filters and recording work as live.
+// Playback runs at real time, a multiple of it, or as fast as possible.
+class SessionReplay : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SessionReplay(QObject *parent = nullptr);
+    virtual ~SessionReplay();
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const {return m_data != nullptr;}
+    QString errorString() const {return m_error;}
+
+    // Device fed by the replay, created by open() and owned by the replay;
+    // it becomes started (ready() is emitted) with the first samples fed
+    NeuroplayDevice *device() const {return m_device;}
+
+    int channels() const {return m_channels.size();}
+    int sampleRate() const {return m_sampleRate;}
+    qint64 sampleCount() const {return m_records * m_samplesPerRecord;}
+    qint64 position() const {return m_position;}
+    void seek(qint64 sample);
+
+    // 1 is real time, 0 is as fast as possible
+    void setSpeed(double speed);
+    double speed() const {return m_speed;}
+    // Samples per delivered block, like the size of a grab response
+    void setBlockSize(int samples) {m_blockSize = qMax(samples, 1);}
+    // Feed the raw stream instead of the filtered one
+    void setRaw(bool raw) {m_raw = raw;}
+
+    // Feeds up to count samples right away, returns the number fed
+    int feed(int count);
+
+public slots:
+    void start();
+    void stop();
+
+signals:
+    void finished();
+
+private:
+    typedef struct
+    {
+        int offset;         // of the channel's samples within a record, in samples
+        double scale;       // physical = digital * scale + shift
+        double shift;
+    } Channel;
+
+    QFile m_file;
+    const uchar *m_data;
+    QString m_error;
+    NeuroplayDevice *m_device;
+
+    QVector<Channel> m_channels;
+    int m_headerBytes;
+    int m_recordSamples;    // over all signals, annotations included
+    int m_samplesPerRecord; // per channel
+    qint64 m_records;
+    int m_sampleRate;
+
+    qint64 m_position;
+    double m_speed;
+    int m_blockSize;
+    bool m_raw;
+
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    qint64 m_clockStart;    // position when the clock was started
+
+    bool fail(const QString &text);
+    void onTick();
+
+    // Time slice of one tick at maximum speed
+    static const int MaxSpeedSliceMs = 20;
+};
+
+#endif // SESSIONREPLAY_H
@@ -0,0 +1,122 @@
+#include "socketworker.h"
+#include "grabdecoder.h"
+#include "sampleclock.h"
+#include "metrics.h"
+#include <QJsonDocument>
+
+SocketWorker::SocketWorker(QObject *parent) : QObject(parent),
+    m_transport(nullptr),
+    m_decoding(false),
+    m_droppedBlocks(0),
+    m_capture(nullptr),
+    m_captureThread(nullptr)
+{
+    setTransport(new WebSocketTransport());
+}
+
+SocketWorker::~SocketWorker()
+{
+    stopCapture();
+}
+
+void SocketWorker::setTransport(Transport *transport)
+{
+    if (!transport || transport == m_transport)
+        return;
+    delete m_transport;
+    m_transport = transport;
+    m_transport->setParent(this);
+    connect(m_transport, &Transport::connected, this, &SocketWorker::connected);
+    connect(m_transport, &Transport::disconnected, this, &SocketWorker::disconnected);
+    connect(m_transport, &Transport::frameReceived, this, &SocketWorker::onFrame);
+}
+
+void SocketWorker::open()
+{
+    m_transport->open();
+}
+
+void SocketWorker::close()
+{
+    m_transport->close();
+}
+
+void SocketWorker::sendFrame(const QByteArray &frame)
+{
+    static MetricsCounter *bytes = NeuroplayMetrics::counter("neuroplay_socket_sent_bytes_total", "Bytes sent to the server");
+    static MetricsCounter *frames = NeuroplayMetrics::counter("neuroplay_socket_sent_frames_total", "Frames sent to the server");
+    bytes->add(frame.size());
+    frames->add();
+    if (m_capture)
+        m_capture->capture(FrameCapture::Outgoing, frame);
+    m_transport->sendFrame(frame);
+}
+
+void SocketWorker::startCapture(const QString &fileName)
+{
+    stopCapture();
+    m_captureThread = new QThread(this);
+    m_captureThread->setObjectName("NeuroplayPro capture");
+    m_capture = new FrameCaptureWriter;
+    m_capture->moveToThread(m_captureThread);
+    connect(m_captureThread, &QThread::finished, m_capture, &QObject::deleteLater);
+    m_captureThread->start();
+    QMetaObject::invokeMethod(m_capture, "open", Qt::QueuedConnection, Q_ARG(QString, fileName));
+}
+
+void SocketWorker::stopCapture()
+{
+    if (!m_capture)
+        return;
+    // the queued frames and the index are written before the thread stops
+    QMetaObject::invokeMethod(m_capture, "close", Qt::BlockingQueuedConnection);
+    m_captureThread->quit();
+    m_captureThread->wait();
+    delete m_captureThread;
+    m_captureThread = nullptr;
+    m_capture = nullptr;
+}
+
+void SocketWorker::onFrame(const QByteArray &frame)
+{
+    static MetricsCounter *bytes = NeuroplayMetrics::counter("neuroplay_socket_received_bytes_total", "Bytes received from the server");
+    static MetricsCounter *frames = NeuroplayMetrics::counter("neuroplay_socket_received_frames_total", "Frames received from the server");
+    static MetricsHistogram *decodeTime = NeuroplayMetrics::histogram("neuroplay_worker_decode_us", "Decoding of sample frames in the worker thread");
+    static MetricsGauge *queued = NeuroplayMetrics::gauge("neuroplay_sample_blocks_queued", "Decoded sample blocks waiting for the device");
+    qint64 arrivalUs = SampleClock::nowUs();
+    bytes->add(frame.size());
+    frames->add();
+    if (m_capture)
+        m_capture->capture(FrameCapture::Incoming, frame);
+    if (!m_decoding)
+    {
+        emit frameReceived(frame);
+        return;
+    }
+
+    QString cmd = GrabDecoder::peekCommand(frame);
+    if (cmd == "stoprecord")
+    {
+        // may be decoded into record sinks, which is up to the receiving side
+        emit frameReceived(frame);
+        return;
+    }
+    if (GrabDecoder::isSampleFrame(cmd, frame))
+    {
+        SampleBlock block;
+        block.command = cmd;
+        block.timeUs = arrivalUs;
+        // the scratch buffer only keeps its allocation between frames
+        if (GrabDecoder::decodeData(frame, m_scratch, ScratchCapacity) >= 0)
+        {
+            block.data = m_scratch.read();
+            decodeTime->record(SampleClock::nowUs() - arrivalUs);
+            if (!m_samples.push(block))
+                m_droppedBlocks.fetchAndAddRelaxed(1);
+            queued->set(m_samples.size());
+            emit samplesReceived();
+            return;
+        }
+    }
+    emit responseReceived(QJsonDocument::fromJson(frame).object());
+}
@@ -0,0 +1,72 @@
+#ifndef SOCKETWORKER_H
+#define SOCKETWORKER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QThread>
+#include <QAtomicInteger>
+#include "samplebuffer.h"
+#include "spscqueue.h"
+#include "framecapture.h"
+#include "transport.h"
+
+typedef struct
+{
+    QString command;
+    QVector< QVector<double> > data;
+    qint64 timeUs;      // arrival, on SampleClock::nowUs()
+} SampleBlock;
+
+// Owns the connection to NeuroPlayPro, a WebSocket to localhost:1336 unless another Transport is set.
+// By default incoming frames are passed on as they are. With decoding enabled (when the worker
+// runs in its own thread) it also parses them: grab sample frames are decoded into
+// SampleBlocks handed over through a lock-free queue, other responses are emitted as JSON objects.
+class SocketWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SocketWorker(QObject *parent = nullptr);
+    virtual ~SocketWorker();
+
+    void setDecoding(bool enable) {m_decoding = enable;}
+    bool isDecoding() const {return m_decoding;}
+
+    // Consumer side of the decoded samples, must be read from a single thread
+    SpscQueue<SampleBlock> &samples() {return m_samples;}
+    // Counted by the worker's thread, readable from any
+    quint64 droppedBlocks() const {return m_droppedBlocks.loadAcquire();}
+
+    // Largest grab frame decoded without loss, in samples
+    static const int ScratchCapacity = 16384;
+
+public slots:
+    // Takes ownership; the previous transport is deleted. Set it from the worker's thread
+    void setTransport(Transport *transport);
+    void open();
+    void close();
+    void sendFrame(const QByteArray &frame);
+    // Writes every frame in both directions to a capture file, see FrameCaptureWriter
+    void startCapture(const QString &fileName);
+    void stopCapture();
+
+signals:
+    void connected();
+    void disconnected();
+    void frameReceived(const QByteArray &frame);
+    void responseReceived(const QJsonObject &resp);
+    void samplesReceived();
+
+private slots:
+    void onFrame(const QByteArray &frame);
+
+private:
+    Transport *m_transport;
+    bool m_decoding;
+    SampleRingBuffer m_scratch;
+    SpscQueue<SampleBlock> m_samples;
+    QAtomicInteger<quint64> m_droppedBlocks;
+    FrameCaptureWriter *m_capture;
+    QThread *m_captureThread;
+};
+
+#endif // SOCKETWORKER_H
@@ -0,0 +1,59 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QVector>
+#include <QAtomicInteger>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two; push() fails when the queue is full.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity = 256)
+    {
+        int size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_items.resize(size);
+        m_data = m_items.data();
+        m_mask = size - 1;
+    }
+
+    bool push(const T &value)
+    {
+        quint32 tail = m_tail.loadAcquire();
+        if (tail - m_head.loadAcquire() > m_mask)
+            return false;
+        m_data[tail & m_mask] = value;
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        quint32 head = m_head.loadAcquire();
+        if (head == m_tail.loadAcquire())
+            return false;
+        T &item = m_data[head & m_mask];
+        value = item;
+        item = T();     // release the payload in the consumer thread
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    bool isEmpty() const {return m_head.loadAcquire() == m_tail.loadAcquire();}
+    // Approximate when read from neither thread
+    int size() const {return int(m_tail.loadAcquire() - m_head.loadAcquire());}
+    int capacity() const {return int(m_mask + 1);}
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+    QVector<T> m_items;
+    T *m_data;
+    quint32 m_mask;
+    QAtomicInteger<quint32> m_head;     // written by the consumer only
+    QAtomicInteger<quint32> m_tail;     // written by the producer only
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,131 @@
+#include "streamcontinuity.h"
+
+StreamContinuity::StreamContinuity()
+{
+    m_stats.blocks = 0;
+    m_stats.gaps = 0;
+    m_stats.droppedSamples = 0;
+    m_stats.duplicatedBlocks = 0;
+    m_stats.overlappingSamples = 0;
+    reset();
+}
+
+void StreamContinuity::reset()
+{
+    m_lastArrivalUs = -1;
+    m_lastIntervalUs = 0;
+    m_delayUs = -1;
+    m_lastGap = 0;
+    m_lastRepeated = 0;
+    m_tail.clear();
+}
+
+int StreamContinuity::check(SampleRingBuffer &buffer, int count, const SampleClock &clock, qint64 arrivalUs)
+{
+    m_lastGap = 0;
+    m_lastRepeated = 0;
+    m_lastIntervalUs = (m_lastArrivalUs >= 0)? arrivalUs - m_lastArrivalUs: 0;
+    m_lastArrivalUs = arrivalUs;
+    count = qBound(0, count, buffer.size());
+    if (!count)
+        return 0;
+    m_stats.blocks++;
+    if (m_tail.channels() != buffer.channels())
+        m_tail.reset(buffer.channels(), MaxOverlapSamples);
+
+    int repeated = overlap(buffer, count);
+    if (repeated)
+    {
+        buffer.removeBeforeNewest(count - repeated, repeated);
+        count -= repeated;
+        m_lastRepeated = repeated;
+        if (!count)
+        {
+            m_stats.duplicatedBlocks++;
+            return 0;
+        }
+        m_stats.overlappingSamples += repeated;
+    }
+    keepTail(buffer, count);
+
+    if (!clock.isValid())
+        return count;
+    double delay = arrivalUs - clock.timeUs(clock.sampleCount() + count - 1);
+    if (m_delayUs < 0)
+    {
+        m_delayUs = qMax(delay, 0.0);
+        return count;
+    }
+
+    // the missing samples were taken since the previous block came
+    double excess = delay - m_delayUs;
+    if (excess > GapToleranceMs * 1000 && excess <= m_lastIntervalUs + GapToleranceMs * 1000)
+    {
+        int gap = qMin(qRound(excess / clock.periodUs()), buffer.capacity() - count);
+        buffer.insertBeforeNewest(count, gap);
+        m_lastGap = gap;
+        m_stats.gaps++;
+        m_stats.droppedSamples += gap;
+        return count + gap;
+    }
+    m_delayUs = qMax(m_delayUs + (delay - m_delayUs) / 16, 0.0);
+    return count;
+}
+
+int StreamContinuity::overlap(const SampleRingBuffer &buffer, int count) const
+{
+    int before = buffer.size() - count;     // the block in buffer
+    int tail = m_tail.size();               // the stream before it
+    int longest = qMin(tail, count);
+    if (longest < 2 || !buffer.channels())
+        return 0;
+
+    // a flat start can't be told from a repeat, and would make every length a candidate
+    bool varies = false;
+    for (int j=0; j<buffer.channels() && !varies; j++)
+    {
+        SampleRingBuffer::Span s = buffer.span(j);
+        for (int i=1; i<longest && !varies; i++)
+            varies = (s[before + i] != s[before]);
+    }
+    if (!varies)
+        return 0;
+
+    SampleRingBuffer::Span first = buffer.span(0);
+    SampleRingBuffer::Span firstTail = m_tail.span(0);
+    for (int n=longest; n>=2; n--)
+    {
+        int start = tail - n;
+        if (firstTail[start] != first[before] || firstTail[tail - 1] != first[before + n - 1])
+            continue;
+        bool same = true;
+        varies = false;
+        for (int j=0; j<buffer.channels() && same; j++)
+        {
+            SampleRingBuffer::Span s = buffer.span(j);
+            SampleRingBuffer::Span t = m_tail.span(j);
+            for (int i=0; i<n && same; i++)
+            {
+                same = (t[start + i] == s[before + i]);
+                varies = varies || (t[start + i] != t[start]);
+            }
+        }
+        if (same && varies)
+            return n;
+    }
+    return 0;
+}
+
+void StreamContinuity::keepTail(const SampleRingBuffer &buffer, int count)
+{
+    count = qMin(count, m_tail.capacity());
+    int skip = buffer.size() - count;
+    for (int j=0; j<buffer.channels(); j++)
+    {
+        SampleRingBuffer::Span s = buffer.span(j);
+        SampleRingBuffer::Writer w = m_tail.writer(j);
+        for (int i=skip; i<s.size(); i++)
+            w.put(s[i]);
+    }
+    m_tail.commit(count);
+}
@@ -0,0 +1,61 @@
+#ifndef STREAMCONTINUITY_H
+#define STREAMCONTINUITY_H
+
+#include "samplebuffer.h"
+#include "sampleclock.h"
+
+// Continuity of a grabbed sample stream. Grab responses carry the samples taken since the
+// previous poll without any sequence number, so losses and repeats are told from the data:
+//  - a block that starts with the samples the stream ended with (the same values on all
+//    channels, up to MaxOverlapSamples) repeats them, e.g. after the server restarted its storage; they are removed.
+//    Flat signals can't be told apart, such runs are left alone;
+//  - a block whose last sample arrives later than its place in the stream allows (see SampleClock)
+//    by more than GapToleranceMs over the usual delay misses samples, e.g. when a poll came after
+//    the server's storage time rolled over; the gap is filled with the last value, so the buffer
+//    keeps one sample per sample period.
+// The arrival times must be taken where the frames arrive: with the worker thread a stalled
+// GUI thread doesn't look like a gap.
+class StreamContinuity
+{
+public:
+    typedef struct
+    {
+        quint64 blocks;
+        quint64 gaps;
+        quint64 droppedSamples;     // missing, filled in
+        quint64 duplicatedBlocks;   // repeated as a whole, removed
+        quint64 overlappingSamples; // repeated at the start of a block, removed
+    } Stats;
+
+    StreamContinuity();
+
+    void reset();
+
+    // Checks the newest count samples of buffer, which arrived at arrivalUs, against the samples
+    // before them and against clock (without them yet). Returns the number of newest samples
+    // that are new to the stream after the repairs.
+    int check(SampleRingBuffer &buffer, int count, const SampleClock &clock, qint64 arrivalUs);
+
+    const Stats &stats() const {return m_stats;}
+    // Of the last check
+    int lastGap() const {return m_lastGap;}
+    int lastRepeated() const {return m_lastRepeated;}
+    qint64 lastIntervalUs() const {return m_lastIntervalUs;}
+
+    static const int GapToleranceMs = 200;
+    static const int MaxOverlapSamples = 1000;
+
+private:
+    Stats m_stats;
+    qint64 m_lastArrivalUs;
+    qint64 m_lastIntervalUs;
+    double m_delayUs;           // usual delay of the last sample of a block
+    int m_lastGap;
+    int m_lastRepeated;
+    SampleRingBuffer m_tail;    // the newest samples of the stream, readers may have taken them from the buffer
+
+    int overlap(const SampleRingBuffer &buffer, int count) const;
+    void keepTail(const SampleRingBuffer &buffer, int count);
+};
+
+#endif // STREAMCONTINUITY_H
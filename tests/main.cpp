@@ -0,0 +1,46 @@
+#include <QApplication>
+#include <QtTest>
+
+// One test object per SDK component, defined in the tst_*.cpp files
+QObject *newSampleBufferTest();
+QObject *newGrabDecoderTest();
+QObject *newRequestQueueTest();
+QObject *newCommandWriterTest();
+QObject *newFilterBankTest();
+QObject *newEdfRecorderTest();
+QObject *newBase64DecoderTest();
+QObject *newFrameCaptureTest();
+QObject *newSampleClockTest();
+QObject *newStreamContinuityTest();
+QObject *newMetricsTest();
+QObject *newRecordSinksTest();
+QObject *newGrabSchedulerTest();
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+    QList<QObject *> tests = {
+        newSampleBufferTest(),
+        newGrabDecoderTest(),
+        newRequestQueueTest(),
+        newCommandWriterTest(),
+        newFilterBankTest(),
+        newEdfRecorderTest(),
+        newBase64DecoderTest(),
+        newFrameCaptureTest(),
+        newSampleClockTest(),
+        newStreamContinuityTest(),
+        newMetricsTest(),
+        newRecordSinksTest(),
+        newGrabSchedulerTest()
+    };
+
+    int failed = 0;
+    for (QObject *test: tests)
+    {
+        if (QTest::qExec(test, argc, argv))
+            failed++;
+        delete test;
+    }
+    return failed? 1: 0;
+}
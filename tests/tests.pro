@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Unit tests for the NeuroplaySDK components
+#
+#-------------------------------------------------
+
+QT       += core gui widgets network websockets testlib
+
+TARGET = NeuroplayTests
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../neuroplaysdk.pri)
+
+SOURCES += \
+        main.cpp \
+    tst_base64decoder.cpp \
+    tst_commandwriter.cpp \
+    tst_edfrecorder.cpp \
+    tst_filterbank.cpp \
+    tst_framecapture.cpp \
+    tst_grabdecoder.cpp \
+    tst_grabscheduler.cpp \
+    tst_metrics.cpp \
+    tst_recordsinks.cpp \
+    tst_requestqueue.cpp \
+    tst_sampleclock.cpp \
+    tst_samplebuffer.cpp \
+    tst_streamcontinuity.cpp
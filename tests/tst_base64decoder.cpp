@@ -0,0 +1,85 @@
+#include <QtTest>
+#include "base64decoder.h"
+
+class Base64DecoderTest : public QObject
+{
+    Q_OBJECT
+
+    // Decodes text in pieces split at the given points
+    static QByteArray decode(const QByteArray &text, const QVector<int> &splits = QVector<int>())
+    {
+        Base64Decoder decoder;
+        QByteArray out(Base64Decoder::maxDecodedSize(text.size()) + 3, 0);
+        int written = 0, from = 0;
+        for (int to: splits + QVector<int>{text.size()})
+        {
+            int n = decoder.decode(text.constData() + from, to - from, out.data() + written);
+            if (n < 0)
+                return QByteArray("<invalid>");
+            written += n;
+            from = to;
+        }
+        written += decoder.finish(out.data() + written);
+        return out.left(written);
+    }
+
+private slots:
+    void matchesQtDecoding()
+    {
+        QByteArray data;
+        for (int i=0; i<50; i++)
+        {
+            QCOMPARE(decode(data.toBase64()), data);
+            QCOMPARE(decode(data.toBase64(QByteArray::OmitTrailingEquals)), data);
+            data += char(i * 37 + 11);
+        }
+    }
+
+    void anySplitPoint()
+    {
+        QByteArray data = "NeuroPlay recording \x01\x02\xff\xfe";
+        QByteArray text = data.toBase64();
+        for (int a=0; a<=text.size(); a++)
+            for (int b=a; b<=text.size(); b++)
+                QCOMPARE(decode(text, {a, b}), data);
+    }
+
+    void jsonEscapesAndWhitespace()
+    {
+        QByteArray data = QByteArray::fromHex("fbff00fe");
+        // "+/8A/g==" as written in a JSON string with escaped slashes and line breaks
+        QByteArray text = "+\\/8A\\n\\/g\r\n==";
+        QCOMPARE(decode(text), data);
+        // the escape may be split from its character
+        QCOMPARE(decode(text, {2}), data);
+    }
+
+    void urlAlphabet()
+    {
+        QCOMPARE(decode("-_8A_g"), QByteArray::fromHex("fbff00fe"));
+    }
+
+    void invalidInput()
+    {
+        QCOMPARE(decode("QUJD*EFG"), QByteArray("<invalid>"));
+        QCOMPARE(decode("QU\"JD"), QByteArray("<invalid>"));
+    }
+
+    void paddingEndsTheData()
+    {
+        Base64Decoder decoder;
+        char out[16];
+        QCOMPARE(decoder.decode("QQ==QUJD", 8, out), 1);
+        QVERIFY(decoder.isFinished());
+        QCOMPARE(out[0], 'A');
+        QCOMPARE(decoder.decode("QUJD", 4, out), 0);
+
+        decoder.reset();
+        QVERIFY(!decoder.isFinished());
+        QCOMPARE(decoder.decode("QUJD", 4, out), 3);
+    }
+};
+
+QObject *newBase64DecoderTest() {return new Base64DecoderTest;}
+
+#include "tst_base64decoder.moc"
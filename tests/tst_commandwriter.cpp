@@ -0,0 +1,45 @@
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "commandwriter.h"
+
+class CommandWriterTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void compactText()
+    {
+        QCOMPARE(CommandWriter("startdevice").add("sn", QString("NP8-01")).add("channels", 8).toUtf8(),
+                 QByteArray("{\"command\":\"startdevice\",\"sn\":\"NP8-01\",\"channels\":8}"));
+        QCOMPARE(CommandWriter("version").toUtf8(), QByteArray("{\"command\":\"version\"}"));
+    }
+
+    void stringsAreEscaped()
+    {
+        QString value = QString::fromUtf8("a \"quoted\" \\ path\n\ttab \x01 \xd0\xbc\xd0\xb8\xd1\x80");
+        QByteArray text = CommandWriter("makefavorite").add("value", value).toUtf8();
+        QVERIFY(!text.contains('\n'));
+
+        QJsonParseError error;
+        QJsonObject o = QJsonDocument::fromJson(text, &error).object();
+        QCOMPARE(error.error, QJsonParseError::NoError);
+        QCOMPARE(o["command"].toString(), QString("makefavorite"));
+        QCOMPARE(o["value"].toString(), value);
+    }
+
+    void numbersRoundTrip()
+    {
+        QByteArray text = CommandWriter("setfilters").add("lpf", 0.1).add("hpf", 45.5).add("tiny", 1e-7).add("n", -3).toUtf8();
+        QJsonObject o = QJsonDocument::fromJson(text).object();
+        QCOMPARE(o["lpf"].toDouble(), 0.1);
+        QCOMPARE(o["hpf"].toDouble(), 45.5);
+        QCOMPARE(o["tiny"].toDouble(), 1e-7);
+        QCOMPARE(o["n"].toInt(), -3);
+        // no locale decimal commas, no trailing zeros
+        QVERIFY(text.contains("\"lpf\":0.1,"));
+    }
+};
+
+QObject *newCommandWriterTest() {return new CommandWriterTest;}
+
+#include "tst_commandwriter.moc"
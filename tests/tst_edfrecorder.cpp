@@ -0,0 +1,172 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QRegularExpression>
+#include <QtEndian>
+#include "edfrecorder.h"
+
+class EdfRecorderTest : public QObject
+{
+    Q_OBJECT
+
+    static QByteArray record(const QString &fileName, double physicalMin, double physicalMax, const QVector< QVector<double> > &data)
+    {
+        EdfRecorder recorder;
+        recorder.open(fileName, data.size(), 10, physicalMin, physicalMax);
+        SampleBlock block;
+        block.command = "grabfiltereddata";
+        block.data = data;
+        block.timeUs = 0;
+        recorder.samples().push(block);
+        recorder.writePending();
+        recorder.close();
+
+        QFile file(fileName);
+        file.open(QIODevice::ReadOnly);
+        return file.readAll();
+    }
+
+    static double number(const QByteArray &edf, int offset)
+    {
+        return edf.mid(offset, 8).trimmed().toDouble();
+    }
+
+    // Channel j of all data records, scaled back with the header fields like a reader does
+    static QVector<double> physical(const QByteArray &edf, int channels, int j)
+    {
+        int headerBytes = int(number(edf, 184));
+        int records = int(number(edf, 236));
+        int signals = 256 + channels * (16 + 80 + 8);
+        double pmin = number(edf, signals + j * 8);
+        double pmax = number(edf, signals + channels * 8 + j * 8);
+        double dmin = number(edf, signals + channels * 16 + j * 8);
+        double dmax = number(edf, signals + channels * 24 + j * 8);
+        int rate = int(number(edf, signals + channels * 32 + channels * 80 + j * 8));
+
+        QVector<double> values;
+        const uchar *data = reinterpret_cast<const uchar *>(edf.constData()) + headerBytes;
+        for (int r=0; r<records; r++)
+        {
+            const uchar *p = data + (r * channels + j) * rate * 2;
+            for (int i=0; i<rate; i++)
+            {
+                qint16 d = qFromLittleEndian<qint16>(p + i * 2);
+                values << (d - dmin) * (pmax - pmin) / (dmax - dmin) + pmin;
+            }
+        }
+        return values;
+    }
+
+private slots:
+    void header()
+    {
+        QTemporaryDir dir;
+        QString fileName = dir.filePath("header.edf");
+        QByteArray edf = record(fileName, -100, 100, {QVector<double>(15, 1.0), QVector<double>(15, 2.0)});
+
+        QCOMPARE(edf.size(), 256 + 2 * 256 + 2 * 2 * 10 * 2);
+        QCOMPARE(edf.left(8), QByteArray("0       "));
+        QVERIFY(QRegularExpression("^Startdate \\d\\d-(JAN|FEB|MAR|APR|MAY|JUN|JUL|AUG|SEP|OCT|NOV|DEC)-\\d{4} ")
+                .match(QString::fromLatin1(edf.mid(88, 80))).hasMatch());
+        QCOMPARE(int(number(edf, 184)), 768);
+        QCOMPARE(edf.mid(236, 8), QByteArray("2       "));   // 1.5 s in whole records
+        QCOMPARE(edf.mid(244, 8), QByteArray("1       "));
+        QCOMPARE(edf.mid(252, 4), QByteArray("2   "));
+        QCOMPARE(edf.mid(256, 16), QByteArray("EEG 1           "));
+        QCOMPARE(edf.mid(256 + 2 * 104, 8), QByteArray("-100.000"));
+        QCOMPARE(edf.mid(256 + 2 * 104 + 16, 8), QByteArray("100.0000"));
+    }
+
+    void samplesScaleBackWithTheHeader_data()
+    {
+        QTest::addColumn<double>("physicalMin");
+        QTest::addColumn<double>("physicalMax");
+        QTest::newRow("symmetric") << -3276.8 << 3276.7;
+        QTest::newRow("fine") << -0.123456789 << 0.987654321;
+        // too wide for decimals in 8 characters, the header gets the rounded range
+        QTest::newRow("wide") << -123456.789 << 234567.891;
+    }
+
+    void samplesScaleBackWithTheHeader()
+    {
+        QFETCH(double, physicalMin);
+        QFETCH(double, physicalMax);
+        QVector<double> a, b;
+        for (int i=0; i<20; i++)
+        {
+            a << physicalMin + (physicalMax - physicalMin) * i / 19;
+            b << physicalMax - (physicalMax - physicalMin) * i * i / 361;
+        }
+
+        QTemporaryDir dir;
+        QByteArray edf = record(dir.filePath("scale.edf"), physicalMin, physicalMax, {a, b});
+        double step = (physicalMax - physicalMin) / 65535;
+        QVector<double> x = physical(edf, 2, 0), y = physical(edf, 2, 1);
+        QCOMPARE(x.size(), 20);
+        for (int i=0; i<20; i++)
+        {
+            QVERIFY2(qAbs(x[i] - a[i]) <= step, qPrintable(QString("%1: %2 vs %3").arg(i).arg(x[i]).arg(a[i])));
+            QVERIFY2(qAbs(y[i] - b[i]) <= step, qPrintable(QString("%1: %2 vs %3").arg(i).arg(y[i]).arg(b[i])));
+        }
+    }
+
+    void outOfRangeIsClipped()
+    {
+        QTemporaryDir dir;
+        QByteArray edf = record(dir.filePath("clip.edf"), -100, 100, {{-1000, 1000, 0, 0, 0, 0, 0, 0, 0, 0}});
+        QVector<double> x = physical(edf, 1, 0);
+        QCOMPARE(x[0], -100.0);
+        QCOMPARE(x[1], 100.0);
+    }
+
+    void emptyRangeIsRejected()
+    {
+        QTemporaryDir dir;
+        EdfRecorder recorder;
+        QSignalSpy errors(&recorder, &EdfRecorder::error);
+        recorder.open(dir.filePath("empty.edf"), 1, 10, 0.0000001, 0.0000002);
+        QCOMPARE(errors.size(), 1);
+    }
+
+    void otherChannelCountIsDropped()
+    {
+        QTemporaryDir dir;
+        EdfRecorder recorder;
+        recorder.open(dir.filePath("channels.edf"), 2, 10, -100, 100);
+        SampleBlock block;
+        block.timeUs = 0;
+        block.data = {QVector<double>(10, 1.0), QVector<double>(10, 2.0)};
+        recorder.samples().push(block);
+        block.data = {QVector<double>(10, 1.0)};
+        recorder.samples().push(block);
+        recorder.writePending();
+        QCOMPARE(recorder.droppedBlocks(), quint64(1));
+
+        QSignalSpy finished(&recorder, &EdfRecorder::finished);
+        recorder.close();
+        QCOMPARE(finished.size(), 1);
+        QCOMPARE(finished[0][1].toInt(), 1);
+    }
+
+    void failedWriteIsNotFinished()
+    {
+        if (!QFile::exists("/dev/full"))
+            QSKIP("needs /dev/full");
+        EdfRecorder recorder;
+        QSignalSpy errors(&recorder, &EdfRecorder::error);
+        QSignalSpy finished(&recorder, &EdfRecorder::finished);
+        recorder.open("/dev/full", 1, 10, -100, 100);
+        SampleBlock block;
+        block.timeUs = 0;
+        block.data = {QVector<double>(30, 1.0)};
+        recorder.samples().push(block);
+        recorder.writePending();
+        recorder.close();
+
+        QCOMPARE(errors.size(), 1);
+        QCOMPARE(finished.size(), 0);
+    }
+};
+
+QObject *newEdfRecorderTest() {return new EdfRecorderTest;}
+
+#include "tst_edfrecorder.moc"
@@ -0,0 +1,116 @@
+#include <QtTest>
+#include <QtMath>
+#include "filterbank.h"
+
+class FilterBankTest : public QObject
+{
+    Q_OBJECT
+
+    static const int SampleRate = 500;
+
+    // Amplitude of the last quarter of the filtered sine, the transient is over by then
+    static double amplitude(BiquadFilterBank &filter, double frequency, int count = 4 * SampleRate)
+    {
+        SampleRingBuffer src(1, count), dst;
+        SampleRingBuffer::Writer w = src.writer(0);
+        for (int i=0; i<count; i++)
+            w.put(qSin(2 * M_PI * frequency * i / SampleRate));
+        src.commit(count);
+
+        filter.reset(1, SampleRate);
+        filter.process(src, count, dst, count);
+        SampleRingBuffer::Span s = dst.span(0);
+        double peak = 0;
+        for (int i=count*3/4; i<count; i++)
+            peak = qMax(peak, qAbs(s[i]));
+        return peak;
+    }
+
+private slots:
+    void noFiltersPassThrough()
+    {
+        BiquadFilterBank filter;
+        filter.reset(2, SampleRate);
+        SampleRingBuffer src(2, 16), dst;
+        src.append({{1, 2, 3}, {-1, -2, -3}});
+        filter.process(src, 3, dst, 16);
+        QCOMPARE(dst.channels(), 2);
+        QCOMPARE(dst.read(), (QVector< QVector<double> >{{1, 2, 3}, {-1, -2, -3}}));
+    }
+
+    void lowPass()
+    {
+        BiquadFilterBank filter;
+        filter.setFilters(30, 0, 0);
+        QVERIFY(qAbs(amplitude(filter, 5) - 1) < 0.05);
+        QVERIFY(amplitude(filter, 100) < 0.15);
+    }
+
+    void highPass()
+    {
+        BiquadFilterBank filter;
+        filter.setFilters(0, 5, 0);
+        QVERIFY(qAbs(amplitude(filter, 40) - 1) < 0.05);
+        QVERIFY(amplitude(filter, 0.5) < 0.05);
+    }
+
+    void bandStop()
+    {
+        BiquadFilterBank filter;
+        filter.setFilters(0, 0, 50);
+        QVERIFY(amplitude(filter, 50) < 0.05);
+        QVERIFY(qAbs(amplitude(filter, 10) - 1) < 0.05);
+    }
+
+    void dcOffsetHasNoTransient()
+    {
+        // the state starts in the steady state of the first sample
+        BiquadFilterBank filter;
+        filter.setFilters(30, 0, 50);
+        filter.reset(1, SampleRate);
+        SampleRingBuffer src(1, 100), dst;
+        src.append({QVector<double>(100, 250.0)});
+        filter.process(src, 100, dst, 100);
+        SampleRingBuffer::Span s = dst.span(0);
+        for (int i=0; i<s.size(); i++)
+            QVERIFY(qAbs(s[i] - 250) < 1e-6);
+    }
+
+    void blocksContinueTheState()
+    {
+        BiquadFilterBank whole, split;
+        whole.setFilters(40, 1, 50);
+        split.setFilters(40, 1, 50);
+        whole.reset(2, SampleRate);
+        split.reset(2, SampleRate);
+
+        SampleRingBuffer src(2, 300), dstWhole, dstSplit;
+        QVector<double> a, b;
+        for (int i=0; i<300; i++)
+        {
+            a << 30 * qSin(i * 0.3) + 10;
+            b << 5 * qCos(i * 1.1) - 20;
+        }
+        src.append({a, b});
+        whole.process(src, 300, dstWhole, 300);
+
+        // the newest samples of the source are filtered, here in blocks of 100
+        SampleRingBuffer part(2, 300);
+        for (int k=0; k<3; k++)
+        {
+            part.append({a.mid(k * 100, 100), b.mid(k * 100, 100)});
+            split.process(part, 100, dstSplit, 300);
+        }
+
+        QVector< QVector<double> > x = dstWhole.read(), y = dstSplit.read();
+        QCOMPARE(y.size(), 2);
+        QCOMPARE(y[0].size(), 300);
+        for (int j=0; j<2; j++)
+            for (int i=0; i<300; i++)
+                QVERIFY(qAbs(x[j][i] - y[j][i]) < 1e-9);
+    }
+};
+
+QObject *newFilterBankTest() {return new FilterBankTest;}
+
+#include "tst_filterbank.moc"
@@ -0,0 +1,149 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include "framecapture.h"
+#include "neuroplaypro.h"
+
+using namespace FrameCapture;
+
+class FrameCaptureTest : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir dir;
+
+    // currentdeviceinfo response that makes a started 2-channel device current
+    static QByteArray deviceFrame()
+    {
+        return "{\"command\":\"currentdeviceinfo\",\"result\":true,\"device\":{\"name\":\"Test NP\",\"model\":\"NeuroPlay-8Cap\","
+               "\"serialNumber\":\"TEST1\",\"maxChannels\":2,\"preferredChannelCount\":2,"
+               "\"channelModes\":[{\"channels\":2,\"frequency\":125}]}}";
+    }
+
+    static void write(const QString &fileName, const QVector<QPair<Direction, QByteArray> > &frames, int pauseMs = 0)
+    {
+        FrameCaptureWriter writer;
+        writer.open(fileName);
+        for (const QPair<Direction, QByteArray> &f: frames)
+        {
+            writer.capture(f.first, f.second);
+            if (pauseMs)
+                QTest::qSleep(pauseMs);
+        }
+        writer.close();
+    }
+
+private slots:
+    void roundTrip()
+    {
+        QString fileName = dir.filePath("roundtrip.npcap");
+        write(fileName, {{Outgoing, "version"}, {Incoming, "{\"command\":\"version\",\"version\":\"1.0\"}"}, {Incoming, ""}});
+
+        FrameCaptureReader reader;
+        QVERIFY2(reader.open(fileName), qPrintable(reader.errorString()));
+        QVERIFY(qAbs(reader.startTime() - QDateTime::currentMSecsSinceEpoch()) < 60000);
+        Frame frame;
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.direction, Outgoing);
+        QCOMPARE(frame.data, QByteArray("version"));
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.direction, Incoming);
+        QCOMPARE(frame.data, QByteArray("{\"command\":\"version\",\"version\":\"1.0\"}"));
+        QVERIFY(reader.next(frame));
+        QVERIFY(frame.data.isEmpty());
+        QVERIFY(!reader.next(frame));
+    }
+
+    void seek()
+    {
+        QString fileName = dir.filePath("seek.npcap");
+        write(fileName, {{Incoming, "a"}, {Incoming, "b"}, {Incoming, "c"}, {Incoming, "d"}}, 20);
+
+        FrameCaptureReader reader;
+        QVERIFY(reader.open(fileName));
+        QVector<qint64> times;
+        Frame frame;
+        while (reader.next(frame))
+            times << frame.timeUs;
+        QCOMPARE(times.size(), 4);
+
+        reader.seek(times[2]);
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.data, QByteArray("c"));
+        reader.seek(times[1] + 1);
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.data, QByteArray("c"));
+        reader.seek(0);
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.data, QByteArray("a"));
+    }
+
+    void missingTrailerIsScanned()
+    {
+        QString fileName = dir.filePath("crashed.npcap");
+        write(fileName, {{Incoming, "a"}, {Incoming, "b"}});
+        // cut off the index and half of the last frame, as a crash would
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.resize(16 + (13 + 1) + 13));
+
+        FrameCaptureReader reader;
+        QVERIFY(reader.open(fileName));
+        QCOMPARE(reader.index().size(), 1);
+        Frame frame;
+        QVERIFY(reader.next(frame));
+        QCOMPARE(frame.data, QByteArray("a"));
+        QVERIFY(!reader.next(frame));
+    }
+
+    void notACapture()
+    {
+        QString fileName = dir.filePath("other.bin");
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("not a capture file at all");
+        file.close();
+        FrameCaptureReader reader;
+        QVERIFY(!reader.open(fileName));
+        QVERIFY(!reader.isOpen());
+    }
+
+    void replayFeedsIncomingFrames()
+    {
+        QString fileName = dir.filePath("replay.npcap");
+        write(fileName, {{Outgoing, "currentdeviceinfo"}, {Incoming, deviceFrame()}});
+
+        NeuroplayPro pro;
+        QSignalSpy ready(&pro, &NeuroplayPro::deviceReady);
+        FrameCaptureReader reader;
+        QVERIFY(reader.open(fileName));
+        QCOMPARE(reader.replay(&pro), 1);
+        reader.close();
+
+        QCOMPARE(ready.size(), 1);
+        QVERIFY(pro.currentDevice());
+        QCOMPARE(pro.currentDevice()->name(), QString("Test NP"));
+    }
+
+    void deferredSpectrumOutlivesTheReader()
+    {
+        QString fileName = dir.filePath("spectrum.npcap");
+        write(fileName, {{Incoming, deviceFrame()},
+                         {Incoming, "{\"command\":\"lastspectrum\",\"result\":true,\"spectrum\":[[1.5,2,3],[4,5,6.25]]}"}});
+
+        NeuroplayPro pro;
+        FrameCaptureReader reader;
+        QVERIFY(reader.open(fileName));
+        QCOMPARE(reader.replay(&pro), 2);
+        // nobody listens to spectrumReady, so the frame is kept undecoded past the unmapping
+        reader.close();
+
+        NeuroplayDevice *device = pro.currentDevice();
+        QVERIFY(device);
+        QCOMPARE(device->spectrum(), (NeuroplayDevice::ChannelsData{{1.5, 2, 3}, {4, 5, 6.25}}));
+    }
+};
+
+QObject *newFrameCaptureTest() {return new FrameCaptureTest;}
+
+#include "tst_framecapture.moc"
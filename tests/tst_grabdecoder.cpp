@@ -0,0 +1,128 @@
+#include <QtTest>
+#include "grabdecoder.h"
+
+typedef QVector< QVector<double> > ChannelsData;
+
+class GrabDecoderTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void peekCommand()
+    {
+        QCOMPARE(GrabDecoder::peekCommand("{\"result\":true, \"command\" : \"grabrawdata\",\"data\":[]}"), QString("grabrawdata"));
+        QCOMPARE(GrabDecoder::peekCommand("{\"data\":{\"command\":\"nested\"}}"), QString());
+        QCOMPARE(GrabDecoder::peekCommand("not json"), QString());
+    }
+
+    void sampleFrames()
+    {
+        QVERIFY(GrabDecoder::isSampleFrame("grabfiltereddata", "{\"data\":[]}"));
+        QVERIFY(!GrabDecoder::isSampleFrame("grabfiltereddata", "{\"error\":\"device is not started\"}"));
+        QVERIFY(!GrabDecoder::isSampleFrame("rhythms", "{\"data\":[]}"));
+    }
+
+    void decodeData()
+    {
+        SampleRingBuffer buffer(2, 16);
+        QByteArray frame = "{\"command\":\"grabfiltereddata\",\"data\":[[1.5, -2, 3e2],\n [null, 0.25, -1E-1]]}";
+        QCOMPARE(GrabDecoder::decodeData(frame, buffer, 16), 3);
+        QCOMPARE(buffer.read(), (ChannelsData{{1.5, -2, 300}, {0, 0.25, -0.1}}));
+    }
+
+    void channelsFollowTheFirstOne()
+    {
+        SampleRingBuffer buffer(2, 16);
+        QCOMPARE(GrabDecoder::decodeData("{\"data\":[[1,2,3],[4],[5,6,7,8]]}", buffer, 16), 3);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2, 3}, {4, 0, 0}, {5, 6, 7}}));
+    }
+
+    void channelModeChangeResetsBuffer()
+    {
+        SampleRingBuffer buffer(4, 16);
+        buffer.append({{9}, {9}, {9}, {9}});
+        QCOMPARE(GrabDecoder::decodeData("{\"data\":[[1,2],[3,4]]}", buffer, 32), 2);
+        QCOMPARE(buffer.channels(), 2);
+        QCOMPARE(buffer.capacity(), 32);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2}, {3, 4}}));
+    }
+
+    void emptyMatrix()
+    {
+        SampleRingBuffer buffer(2, 16);
+        QCOMPARE(GrabDecoder::decodeData("{\"data\":[]}", buffer, 16), 0);
+        QCOMPARE(GrabDecoder::decodeData("{\"data\":[[],[]]}", buffer, 16), 0);
+        QVERIFY(buffer.isEmpty());
+    }
+
+    void malformedFrames_data()
+    {
+        QTest::addColumn<QByteArray>("frame");
+        QTest::newRow("no data") << QByteArray("{\"command\":\"grabfiltereddata\"}");
+        QTest::newRow("truncated") << QByteArray("{\"data\":[[1,2,3],[4,5");
+        QTest::newRow("bad number") << QByteArray("{\"data\":[[1,2,3],[4,x,6]]}");
+        QTest::newRow("not a matrix") << QByteArray("{\"data\":[1,2,3]}");
+        QTest::newRow("missing bracket") << QByteArray("{\"data\":[[1,2,3][4,5,6]]}");
+        QTest::newRow("bad exponent") << QByteArray("{\"data\":[[1e,2]]}");
+    }
+
+    void malformedFrames()
+    {
+        QFETCH(QByteArray, frame);
+        // a full buffer must keep its samples when the frame is rejected
+        SampleRingBuffer buffer(2, 4);
+        buffer.append({{1, 2, 3, 4}, {5, 6, 7, 8}});
+        QCOMPARE(GrabDecoder::decodeData(frame, buffer, 4), -1);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2, 3, 4}, {5, 6, 7, 8}}));
+    }
+
+    void parseNumber_data()
+    {
+        QTest::addColumn<QByteArray>("text");
+        QTest::addColumn<double>("value");
+        QTest::addColumn<int>("length");
+        QTest::newRow("integer") << QByteArray("42,") << 42.0 << 2;
+        QTest::newRow("negative") << QByteArray("-17.25]") << -17.25 << 6;
+        QTest::newRow("exponent") << QByteArray("1.5e-3") << 0.0015 << 6;
+        QTest::newRow("plus exponent") << QByteArray("2E+2 ") << 200.0 << 4;
+        QTest::newRow("null") << QByteArray("null,") << 0.0 << 4;
+        QTest::newRow("long mantissa") << QByteArray("12345678901234567890123") << 12345678901234567890123.0 << 23;
+    }
+
+    void parseNumber()
+    {
+        QFETCH(QByteArray, text);
+        QFETCH(double, value);
+        QFETCH(int, length);
+        const char *p = text.constData();
+        double parsed = -1;
+        QVERIFY(GrabDecoder::parseNumber(p, text.constData() + text.size(), parsed));
+        QCOMPARE(parsed, value);
+        QCOMPARE(int(p - text.constData()), length);
+    }
+
+    void parseNumberRejects()
+    {
+        for (QByteArray text: {QByteArray("-"), QByteArray("abc"), QByteArray("."), QByteArray("1e")})
+        {
+            const char *p = text.constData();
+            double value;
+            QVERIFY2(!GrabDecoder::parseNumber(p, text.constData() + text.size(), value), text.constData());
+            QCOMPARE(int(p - text.constData()), 0);
+        }
+    }
+
+    void recordFiles()
+    {
+        QByteArray frame = "{\"command\":\"stoprecord\",\"files\":[{\"type\":\"edf\",\"data\":\"QUJD\"},{\"data\":\"RA==\",\"type\":\"bdf\"}]}";
+        QVector<GrabDecoder::StringRef> files = GrabDecoder::recordFiles(frame);
+        QCOMPARE(files.size(), 2);
+        QCOMPARE(files[0].name, QString("edf"));
+        QCOMPARE(frame.mid(files[0].offset, files[0].size), QByteArray("QUJD"));
+        QCOMPARE(files[1].name, QString("bdf"));
+        QCOMPARE(frame.mid(files[1].offset, files[1].size), QByteArray("RA=="));
+    }
+};
+
+QObject *newGrabDecoderTest() {return new GrabDecoderTest;}
+
+#include "tst_grabdecoder.moc"
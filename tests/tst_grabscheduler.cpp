@@ -0,0 +1,50 @@
+#include <QtTest>
+#include "grabscheduler.h"
+
+class GrabSchedulerTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void lowerIntervalAppliesToSampleStreams()
+    {
+        GrabScheduler scheduler;
+        scheduler.setInterval(200);
+        scheduler.setEnabled(GrabScheduler::FilteredDataStream, true);
+        scheduler.setEnabled(GrabScheduler::MeditationStream, true);
+        QCOMPARE(scheduler.stats(GrabScheduler::FilteredDataStream).intervalMs, 200.0);
+
+        scheduler.setInterval(20);
+        QCOMPARE(scheduler.interval(), 20);
+        QCOMPARE(scheduler.stats(GrabScheduler::FilteredDataStream).intervalMs, 20.0);
+        QCOMPARE(scheduler.stats(GrabScheduler::RawDataStream).intervalMs, 20.0);
+        // slow streams keep the interval they adapted to
+        QCOMPARE(scheduler.stats(GrabScheduler::MeditationStream).intervalMs, 200.0);
+    }
+
+    void higherIntervalIsAFloor()
+    {
+        GrabScheduler scheduler;
+        scheduler.setInterval(20);
+        scheduler.setInterval(100);
+        QCOMPARE(scheduler.stats(GrabScheduler::FilteredDataStream).intervalMs, 100.0);
+        QCOMPARE(scheduler.stats(GrabScheduler::RhythmsStream).intervalMs, 100.0);
+    }
+
+    void pollsEnabledStreamsOnce()
+    {
+        GrabScheduler scheduler;
+        scheduler.setInterval(10);
+        scheduler.setEnabled(GrabScheduler::RawDataStream, true);
+        QSignalSpy polls(&scheduler, &GrabScheduler::poll);
+        scheduler.start();
+        // the poll is pending until received(), so no second one goes out
+        QTest::qWait(60);
+        scheduler.stop();
+        QCOMPARE(polls.size(), 1);
+        QCOMPARE(polls[0][0].toInt(), int(GrabScheduler::RawDataStream));
+    }
+};
+
+QObject *newGrabSchedulerTest() {return new GrabSchedulerTest;}
+
+#include "tst_grabscheduler.moc"
@@ -0,0 +1,50 @@
+#include <QtTest>
+#include <QTcpSocket>
+#include "metrics.h"
+
+class MetricsTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void labelValueIsEscaped()
+    {
+        QString name = NeuroplayMetrics::name("test_escaped_total", "command", "a\"b\\c\nd");
+        QCOMPARE(name, QString("test_escaped_total{command=\"a\\\"b\\\\c\\nd\"}"));
+
+        NeuroplayMetrics::counter(name, "Help with a \\ and a\nnewline")->add(3);
+        QByteArray text = NeuroplayMetrics::text();
+        QVERIFY(text.contains(name.toUtf8() + " 3\n"));
+        QVERIFY(text.contains("# HELP test_escaped_total Help with a \\\\ and a\\nnewline\n"));
+    }
+
+    void requestLineInPieces()
+    {
+        MetricsServer server;
+        QVERIFY(server.listen(0));
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, server.port());
+        QVERIFY(client.waitForConnected(1000));
+
+        client.write("GET /met");
+        client.flush();
+        QTest::qWait(50);
+        QCOMPARE(client.state(), QAbstractSocket::ConnectedState);
+        client.write("rics HTTP/1.0\r\n\r\n");
+        client.flush();
+
+        // answered once the line is complete, then closed
+        QTRY_COMPARE(client.state(), QAbstractSocket::UnconnectedState);
+        QVERIFY(client.readAll().startsWith("HTTP/1.0 200 OK\r\n"));
+    }
+
+    void plainValueIsUnchanged()
+    {
+        QCOMPARE(NeuroplayMetrics::name("test_plain_total", "command", "grabrawdata"),
+                 QString("test_plain_total{command=\"grabrawdata\"}"));
+    }
+};
+
+QObject *newMetricsTest() {return new MetricsTest;}
+
+#include "tst_metrics.moc"
@@ -0,0 +1,91 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include "framecapture.h"
+#include "neuroplaypro.h"
+
+using namespace FrameCapture;
+
+class RecordSinksTest : public QObject
+{
+    Q_OBJECT
+
+    QTemporaryDir dir;
+
+    // Feeds incoming frames to pro as if they came from the server
+    void feed(NeuroplayPro *pro, const QString &name, const QVector<QByteArray> &frames)
+    {
+        QString fileName = dir.filePath(name + ".npcap");
+        FrameCaptureWriter writer;
+        writer.open(fileName);
+        for (const QByteArray &frame: frames)
+            writer.capture(Incoming, frame);
+        writer.close();
+
+        FrameCaptureReader reader;
+        QVERIFY(reader.open(fileName));
+        QCOMPARE(reader.replay(pro), frames.size());
+    }
+
+    static QByteArray deviceFrame()
+    {
+        return "{\"command\":\"currentdeviceinfo\",\"result\":true,\"device\":{\"name\":\"Test NP\",\"model\":\"NeuroPlay-8Cap\","
+               "\"serialNumber\":\"TEST1\",\"maxChannels\":2,\"preferredChannelCount\":2,"
+               "\"channelModes\":[{\"channels\":2,\"frequency\":125}]}}";
+    }
+
+    static QByteArray stopRecordFrame(const QByteArray &edf, const QByteArray &npd)
+    {
+        return "{\"command\":\"stoprecord\",\"result\":true,\"files\":[{\"type\":\"edf\",\"data\":\"" + edf
+                + "\"},{\"type\":\"npd\",\"data\":\"" + npd + "\"}]}";
+    }
+
+private slots:
+    void filesAreDecodedIntoTheSinks()
+    {
+        NeuroplayPro pro;
+        feed(&pro, "device", {deviceFrame()});
+        NeuroplayDevice *device = pro.currentDevice();
+        QVERIFY(device);
+
+        QBuffer edf, npd;
+        edf.open(QIODevice::WriteOnly);
+        npd.open(QIODevice::WriteOnly);
+        device->setRecordSinks(&edf, &npd);
+        QSignalSpy saved(device, &NeuroplayDevice::recordSaved);
+        QSignalSpy failed(device, &NeuroplayDevice::recordFailed);
+        feed(&pro, "saved", {stopRecordFrame(QByteArray("EDF header").toBase64(), QByteArray("npd").toBase64())});
+
+        QCOMPARE(failed.size(), 0);
+        QCOMPARE(saved.size(), 1);
+        QCOMPARE(saved[0][0].toLongLong(), qint64(10));
+        QCOMPARE(saved[0][1].toLongLong(), qint64(3));
+        QCOMPARE(edf.data(), QByteArray("EDF header"));
+        QCOMPARE(npd.data(), QByteArray("npd"));
+    }
+
+    void corruptFileIsNotReportedAsSaved()
+    {
+        NeuroplayPro pro;
+        feed(&pro, "device", {deviceFrame()});
+        NeuroplayDevice *device = pro.currentDevice();
+        QVERIFY(device);
+
+        QBuffer edf;
+        edf.open(QIODevice::WriteOnly);
+        device->setRecordSinks(&edf);
+        QSignalSpy saved(device, &NeuroplayDevice::recordSaved);
+        QSignalSpy failed(device, &NeuroplayDevice::recordFailed);
+        QSignalSpy recorded(device, &NeuroplayDevice::recordedData);
+        feed(&pro, "corrupt", {stopRecordFrame("RURGIGhl*WRlcg==", QByteArray("npd").toBase64())});
+
+        QCOMPARE(saved.size(), 0);
+        QCOMPARE(recorded.size(), 0);
+        QCOMPARE(failed.size(), 1);
+        QVERIFY(failed[0][0].toString().startsWith("edf"));
+    }
+};
+
+QObject *newRecordSinksTest() {return new RecordSinksTest;}
+
+#include "tst_recordsinks.moc"
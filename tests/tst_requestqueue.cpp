@@ -0,0 +1,117 @@
+#include <QtTest>
+#include "requestqueue.h"
+
+class RequestQueueTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void commandNames()
+    {
+        QCOMPARE(RequestQueue::commandOf(" version\n"), QString("version"));
+        QCOMPARE(RequestQueue::commandOf("{\"command\":\"startdevice\",\"sn\":\"NP8\"}"), QString("startdevice"));
+        // the grab commands are answered under the other name
+        QCOMPARE(RequestQueue::responseOf("GrabRawData"), QString("grabfiltereddata"));
+        QCOMPARE(RequestQueue::responseOf("graboriginaldata"), QString("grabrawdata"));
+        QVERIFY(RequestQueue::isPoll("grabfiltereddata"));
+        QVERIFY(RequestQueue::isPoll("lastspectrum"));
+        QVERIFY(!RequestQueue::isPoll("startdevice"));
+        QVERIFY(!RequestQueue::isPoll("version"));
+        QVERIFY(!RequestQueue::isPoll("currentdeviceinfo"));
+    }
+
+    void queuedRequestsGoInFlight()
+    {
+        RequestQueue queue;
+        quint32 first = queue.enqueue("startsearch");
+        quint32 second = queue.enqueue("version");
+        QVERIFY(first);
+        QVERIFY(second > first);
+        QCOMPARE(queue.queuedCount(), 2);
+
+        QList<RequestQueue::Request> sent = queue.takeQueued();
+        QCOMPARE(sent.size(), 2);
+        QCOMPARE(sent[0].text, QByteArray("startsearch"));
+        QCOMPARE(sent[1].id, second);
+        QCOMPARE(queue.queuedCount(), 0);
+        QCOMPARE(queue.inFlightCount(), 2);
+        QCOMPARE(queue.sentCount(), quint64(2));
+    }
+
+    void pollsAreDeduplicated()
+    {
+        RequestQueue queue;
+        QVERIFY(queue.enqueue("grabrawdata"));
+        QCOMPARE(queue.enqueue("grabrawdata"), quint32(0));
+        queue.takeQueued();
+        QCOMPARE(queue.enqueue("grabrawdata"), quint32(0));
+        QCOMPARE(queue.deduplicatedCount(), quint64(2));
+
+        // other polls and commands with side effects are always queued
+        QVERIFY(queue.enqueue("rhythms"));
+        QVERIFY(queue.enqueue("startrecord"));
+        QVERIFY(queue.enqueue("startrecord"));
+        QVERIFY(queue.enqueue("version"));
+        QVERIFY(queue.enqueue("version"));
+    }
+
+    void requestsCanSkipDeduplication()
+    {
+        RequestQueue queue;
+        QVERIFY(queue.enqueue("grabrawdata"));
+        QVERIFY(queue.enqueue("grabrawdata", false));
+        QCOMPARE(queue.queuedCount(), 2);
+        QCOMPARE(queue.deduplicatedCount(), quint64(0));
+    }
+
+    void responsesMatchOldestRequest()
+    {
+        RequestQueue queue;
+        queue.enqueue("grabrawdata");
+        queue.enqueue("startdevice");
+        queue.enqueue("startdevice");
+        queue.takeQueued();
+
+        QVERIFY(queue.respond("grabfiltereddata") >= 0);
+        QCOMPARE(queue.respond("grabfiltereddata"), qint64(-1));
+        QVERIFY(queue.respond("startdevice") >= 0);
+        QCOMPARE(queue.inFlightCount(), 1);
+        // answered, so the same poll is accepted again
+        QVERIFY(queue.enqueue("grabrawdata"));
+    }
+
+    void expiryBoundary()
+    {
+        QVERIFY(!RequestQueue::isExpired(100, 100 + RequestQueue::RequestTimeoutMs - 1));
+        QVERIFY(RequestQueue::isExpired(100, 100 + RequestQueue::RequestTimeoutMs));
+    }
+
+    void lostResponseDoesNotBlockPolls()
+    {
+        RequestQueue queue;
+        QVERIFY(queue.enqueue("grabfiltereddata"));
+        queue.takeQueued();
+        QCOMPARE(queue.enqueue("grabfiltereddata"), quint32(0));
+
+        // the response never comes; the retry expires the stale entry itself, without a flush in between
+        QTest::qSleep(RequestQueue::RequestTimeoutMs + 10);
+        QVERIFY(queue.enqueue("grabfiltereddata"));
+        QCOMPARE(queue.timedOutCount(), quint64(1));
+        QCOMPARE(queue.inFlightCount(), 0);
+        QCOMPARE(queue.queuedCount(), 1);
+    }
+
+    void clear()
+    {
+        RequestQueue queue;
+        queue.enqueue("version");
+        queue.takeQueued();
+        queue.enqueue("help");
+        queue.clear();
+        QCOMPARE(queue.queuedCount(), 0);
+        QCOMPARE(queue.inFlightCount(), 0);
+    }
+};
+
+QObject *newRequestQueueTest() {return new RequestQueueTest;}
+
+#include "tst_requestqueue.moc"
@@ -0,0 +1,109 @@
+#include <QtTest>
+#include "samplebuffer.h"
+
+typedef QVector< QVector<double> > ChannelsData;
+
+class SampleBufferTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void appendAndRead()
+    {
+        SampleRingBuffer buffer(2, 8);
+        buffer.append({{1, 2, 3}, {10, 20, 30}});
+        QCOMPARE(buffer.size(), 3);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2, 3}, {10, 20, 30}}));
+        QVERIFY(buffer.isEmpty());
+    }
+
+    void shortChannelsArePadded()
+    {
+        SampleRingBuffer buffer(2, 8);
+        buffer.append({{1, 2, 3}, {10}});
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2, 3}, {10, 0, 0}}));
+    }
+
+    void partialReadConsumesOldest()
+    {
+        SampleRingBuffer buffer(1, 8);
+        buffer.append({{1, 2, 3, 4}});
+        QCOMPARE(buffer.read(3), (ChannelsData{{1, 2, 3}}));
+        QCOMPARE(buffer.read(3), (ChannelsData{{4}}));
+        QCOMPARE(buffer.read(3), ChannelsData());
+    }
+
+    void spanSplitsAtWraparound()
+    {
+        SampleRingBuffer buffer(2, 4);
+        buffer.append({{1, 2, 3}, {10, 20, 30}});
+        buffer.consume(2);
+        buffer.append({{4, 5, 6}, {40, 50, 60}});
+        QCOMPARE(buffer.size(), 4);
+
+        SampleRingBuffer::Span s = buffer.span(1);
+        QCOMPARE(s.firstSize, 2);
+        QCOMPARE(s.secondSize, 2);
+        QCOMPARE(s.first[0], 30.0);
+        QCOMPARE(s.second[0], 50.0);
+        QCOMPARE(s[3], 60.0);
+        QCOMPARE(buffer.span(0, 3).size(), 3);
+        QCOMPARE(buffer.read(), (ChannelsData{{3, 4, 5, 6}, {30, 40, 50, 60}}));
+    }
+
+    void fullBufferDropsOldest()
+    {
+        SampleRingBuffer buffer(1, 4);
+        buffer.append({{1, 2, 3}});
+        buffer.append({{4, 5, 6}});
+        QCOMPARE(buffer.size(), 4);
+        QCOMPARE(buffer.read(), (ChannelsData{{3, 4, 5, 6}}));
+    }
+
+    void blockLargerThanCapacity()
+    {
+        SampleRingBuffer buffer(1, 4);
+        buffer.append({{1, 2, 3, 4, 5, 6, 7, 8, 9}});
+        QCOMPARE(buffer.read(), (ChannelsData{{6, 7, 8, 9}}));
+    }
+
+    void writerIsInvisibleUntilCommit()
+    {
+        SampleRingBuffer buffer(1, 4);
+        SampleRingBuffer::Writer w = buffer.writer(0);
+        w.put(1);
+        w.put(2);
+        QVERIFY(buffer.isEmpty());
+        buffer.commit(2);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2}}));
+    }
+
+    void insertRepeatsTheSampleBeforeNewest()
+    {
+        SampleRingBuffer buffer(1, 10);
+        buffer.append({{1, 2, 3, 4}});
+        buffer.insertBeforeNewest(2, 2);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 2, 2, 2, 3, 4}}));
+    }
+
+    void removeClosesUpBeforeNewest()
+    {
+        SampleRingBuffer buffer(1, 10);
+        buffer.append({{1, 2, 3, 4}});
+        buffer.removeBeforeNewest(2, 1);
+        QCOMPARE(buffer.read(), (ChannelsData{{1, 3, 4}}));
+    }
+
+    void resetChangesShape()
+    {
+        SampleRingBuffer buffer(1, 4);
+        buffer.append({{1, 2}});
+        buffer.reset(3, 16);
+        QCOMPARE(buffer.channels(), 3);
+        QCOMPARE(buffer.capacity(), 16);
+        QVERIFY(buffer.isEmpty());
+    }
+};
+
+QObject *newSampleBufferTest() {return new SampleBufferTest;}
+
+#include "tst_samplebuffer.moc"
@@ -0,0 +1,75 @@
+#include <QtTest>
+#include "sampleclock.h"
+
+class SampleClockTest : public QObject
+{
+    Q_OBJECT
+
+    static const int SampleRate = 500;
+    static const int BlockSize = 25;
+    static constexpr double StartUs = 1e9;
+    static constexpr double DelayUs = 5000;
+
+    // Blocks of a device sampling with truePeriodUs, sent right after their last sample and
+    // delayed by DelayUs plus up to 3.5 ms of jitter; one block per second has no jitter
+    static void feed(SampleClock &clock, double truePeriodUs, int seconds)
+    {
+        int blocks = seconds * SampleRate / BlockSize;
+        for (int k=0; k<blocks; k++)
+        {
+            double jitter = (k % 20 == 3)? 0: 500 + (k * 7919) % 3000;
+            qint64 last = qint64(k + 1) * BlockSize - 1;
+            clock.addBlock(BlockSize, qint64(StartUs + last * truePeriodUs + DelayUs + jitter));
+            QVERIFY(clock.lastDelayUs() > -0.001);
+        }
+    }
+
+private slots:
+    void nominalRate()
+    {
+        SampleClock clock;
+        clock.reset(SampleRate);
+        QVERIFY(!clock.isValid());
+        feed(clock, 2000, 30);
+        QCOMPARE(clock.sampleCount(), qint64(30 * SampleRate));
+        QVERIFY(qAbs(clock.driftPpm()) < 1);
+        QVERIFY(qAbs(clock.timeUs(0) - (StartUs + DelayUs)) < 1);
+        QVERIFY(qAbs(clock.timeUs(10000) - (StartUs + DelayUs + 10000 * 2000.0)) < 1);
+    }
+
+    void drift()
+    {
+        SampleClock clock;
+        clock.reset(SampleRate);
+        feed(clock, 2000 * (1 + 150e-6), 60);
+        QVERIFY2(qAbs(clock.driftPpm() - 150) < 1, qPrintable(QString::number(clock.driftPpm())));
+        // the newest samples are placed right, not only the average rate
+        qint64 last = clock.sampleCount() - 1;
+        QVERIFY(qAbs(clock.timeUs(last) - (StartUs + DelayUs + last * 2000 * (1 + 150e-6))) < 5);
+    }
+
+    void driftIsBounded()
+    {
+        SampleClock clock;
+        clock.reset(SampleRate);
+        feed(clock, 2000 * 1.01, 10);
+        QCOMPARE(clock.driftPpm(), double(SampleClock::MaxDriftPpm));
+    }
+
+    void resetStartsOver()
+    {
+        SampleClock clock;
+        clock.reset(SampleRate);
+        feed(clock, 2000, 3);
+        clock.reset(250);
+        QCOMPARE(clock.sampleRate(), 250);
+        QCOMPARE(clock.sampleCount(), qint64(0));
+        QCOMPARE(clock.periodUs(), 4000.0);
+        clock.addBlock(0, 123);
+        QVERIFY(!clock.isValid());
+    }
+};
+
+QObject *newSampleClockTest() {return new SampleClockTest;}
+
+#include "tst_sampleclock.moc"
@@ -0,0 +1,110 @@
+#include <QtTest>
+#include "streamcontinuity.h"
+
+typedef QVector< QVector<double> > ChannelsData;
+
+class StreamContinuityTest : public QObject
+{
+    Q_OBJECT
+
+    SampleRingBuffer buffer;
+    SampleClock clock;
+    StreamContinuity continuity;
+
+    // Appends a block the way the device does: continuity first, then the clock
+    int receive(const ChannelsData &block, qint64 arrivalUs)
+    {
+        buffer.append(block);
+        int count = continuity.check(buffer, block[0].size(), clock, arrivalUs);
+        clock.addBlock(count, arrivalUs);
+        return count;
+    }
+
+    // Samples from..to-1 of a 500 Hz stream whose values are their indices, on two channels
+    static ChannelsData samples(int from, int to)
+    {
+        ChannelsData data(2);
+        for (int i=from; i<to; i++)
+        {
+            data[0] << i;
+            data[1] << -i;
+        }
+        return data;
+    }
+
+    // Arrival of a block ending with sample index last, 5 ms after it was taken
+    static qint64 arrival(int last) {return 1000000 + qint64(last) * 2000 + 5000;}
+
+private slots:
+    void init()
+    {
+        buffer.reset(2, 10000);
+        clock.reset(500);
+        continuity.reset();
+    }
+
+    void continuousStream()
+    {
+        for (int k=0; k<20; k++)
+            QCOMPARE(receive(samples(k * 25, k * 25 + 25), arrival(k * 25 + 24)), 25);
+        QCOMPARE(continuity.lastGap(), 0);
+        QCOMPARE(continuity.lastRepeated(), 0);
+        QCOMPARE(continuity.lastIntervalUs(), qint64(50000));
+        QCOMPARE(buffer.read(), samples(0, 500));
+    }
+
+    void repeatedStartIsRemoved()
+    {
+        receive(samples(0, 25), arrival(24));
+        QCOMPARE(receive(samples(20, 50), arrival(49)), 25);
+        QCOMPARE(continuity.lastRepeated(), 5);
+        QCOMPARE(continuity.stats().overlappingSamples, quint64(5));
+        QCOMPARE(buffer.read(), samples(0, 50));
+    }
+
+    void repeatedBlockIsDropped()
+    {
+        receive(samples(0, 25), arrival(24));
+        QCOMPARE(receive(samples(0, 25), arrival(49)), 0);
+        QCOMPARE(continuity.stats().duplicatedBlocks, quint64(1));
+        QCOMPARE(buffer.read(), samples(0, 25));
+    }
+
+    void flatSignalIsLeftAlone()
+    {
+        receive({QVector<double>(25, 7.0), QVector<double>(25, 0.0)}, arrival(24));
+        QCOMPARE(receive({QVector<double>(25, 7.0), QVector<double>(25, 0.0)}, arrival(49)), 25);
+        QCOMPARE(buffer.size(), 50);
+    }
+
+    void lostSamplesAreFilled()
+    {
+        for (int k=0; k<10; k++)
+            receive(samples(k * 25, k * 25 + 25), arrival(k * 25 + 24));
+        // a poll missed samples 250..499, the next block is 500..524
+        QCOMPARE(receive(samples(500, 525), arrival(524)), 275);
+        QCOMPARE(continuity.lastGap(), 250);
+        QCOMPARE(continuity.stats().gaps, quint64(1));
+        QCOMPARE(continuity.stats().droppedSamples, quint64(250));
+
+        ChannelsData data = buffer.read();
+        QCOMPARE(data[0].size(), 525);
+        QCOMPARE(data[0][249], 249.0);
+        QCOMPARE(data[0][250], 249.0);     // the last value holds through the gap
+        QCOMPARE(data[1][499], -249.0);
+        QCOMPARE(data[0][500], 500.0);
+    }
+
+    void lateBlockWithoutLossIsNoGap()
+    {
+        for (int k=0; k<10; k++)
+            receive(samples(k * 25, k * 25 + 25), arrival(k * 25 + 24));
+        // delayed by 100 ms, within the tolerance
+        QCOMPARE(receive(samples(250, 275), arrival(274) + 100000), 25);
+        QCOMPARE(continuity.lastGap(), 0);
+    }
+};
+
+QObject *newStreamContinuityTest() {return new StreamContinuityTest;}
+
+#include "tst_streamcontinuity.moc"
@@ -0,0 +1,177 @@
+#include "transport.h"
+#include "neuroplaylog.h"
+
+// ======================= WebSocketTransport ===================== //
+
+WebSocketTransport::WebSocketTransport(const QUrl &url, Mode mode, QObject *parent) : Transport(parent),
+    m_url(url),
+    m_mode(mode)
+{
+    m_socket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+    connect(m_socket, &QWebSocket::connected, this, &Transport::connected);
+    connect(m_socket, &QWebSocket::disconnected, this, &Transport::disconnected);
+    connect(m_socket, &QWebSocket::textMessageReceived, this, [=](const QString &text)
+    {
+        emit frameReceived(text.toUtf8());
+    });
+    connect(m_socket, &QWebSocket::binaryMessageReceived, this, &Transport::frameReceived);
+}
+
+void WebSocketTransport::open()
+{
+    m_socket->open(m_url);
+}
+
+void WebSocketTransport::close()
+{
+    m_socket->close();
+}
+
+void WebSocketTransport::sendFrame(const QByteArray &frame)
+{
+    if (m_mode == Binary)
+        m_socket->sendBinaryMessage(frame);
+    else // QWebSocket takes text frames as QString only
+        m_socket->sendTextMessage(QString::fromUtf8(frame));
+}
+
+// ====================== InProcessTransport ====================== //
+
+InProcessTransport::InProcessTransport(Responder responder, QObject *parent) : Transport(parent),
+    m_responder(responder),
+    m_isOpen(false),
+    m_connectPending(false),
+    m_deliveryScheduled(false)
+{
+}
+
+void InProcessTransport::open()
+{
+    if (m_isOpen)
+        return;
+    m_isOpen = true;
+    m_connectPending = true;
+    scheduleDelivery();
+}
+
+void InProcessTransport::close()
+{
+    if (!m_isOpen)
+        return;
+    m_isOpen = false;
+    m_connectPending = false;
+    m_responses.clear();
+    emit disconnected();
+}
+
+void InProcessTransport::sendFrame(const QByteArray &frame)
+{
+    if (!m_isOpen)
+        return;
+    QByteArray response = m_responder(frame);
+    if (response.isEmpty())
+        return;
+    m_responses.enqueue(response);
+    scheduleDelivery();
+}
+
+void InProcessTransport::scheduleDelivery()
+{
+    if (m_deliveryScheduled)
+        return;
+    m_deliveryScheduled = true;
+    QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+}
+
+void InProcessTransport::deliver()
+{
+    m_deliveryScheduled = false;
+    if (m_connectPending)
+    {
+        m_connectPending = false;
+        emit connected();
+    }
+    // the receivers may send (and close) while the queue is being emptied
+    while (m_isOpen && !m_responses.isEmpty())
+        emit frameReceived(m_responses.dequeue());
+}
+
+// ======================== ReplayTransport ======================= //
+
+ReplayTransport::ReplayTransport(const QString &fileName, double speed, QObject *parent) : Transport(parent),
+    m_fileName(fileName),
+    m_speed(qMax(speed, 0.0)),
+    m_hasFrame(false)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, &QTimer::timeout, this, &ReplayTransport::playPending);
+}
+
+void ReplayTransport::open()
+{
+    if (m_reader.isOpen())
+        return;
+    if (!m_reader.open(m_fileName))
+    {
+        qCWarning(lcNeuroplay) << "replay:" << m_reader.errorString();
+        emit disconnected();
+        return;
+    }
+    m_reader.seek(0);
+    m_hasFrame = m_reader.next(m_frame);
+    m_clock.start();
+    emit connected();
+    m_timer->start(0);
+}
+
+void ReplayTransport::close()
+{
+    if (m_reader.isOpen())
+        finish();
+}
+
+void ReplayTransport::sendFrame(const QByteArray &frame)
+{
+    // the responses are in the file already
+    Q_UNUSED(frame)
+}
+
+void ReplayTransport::playPending()
+{
+    qint64 nowUs = (m_speed > 0)? qint64(m_clock.nsecsElapsed() / 1000 * m_speed): -1;
+    int count = 0;
+    while (m_hasFrame && (nowUs < 0 || m_frame.timeUs <= nowUs))
+    {
+        if (nowUs < 0 && count >= MaxSpeedBatch)
+            break;
+        // frame data points into the file mapping, receivers get their own copy
+        if (m_frame.direction == FrameCapture::Incoming)
+        {
+            emit frameReceived(QByteArray(m_frame.data.constData(), m_frame.data.size()));
+            count++;
+        }
+        // a receiver may have closed the transport
+        if (!m_reader.isOpen())
+            return;
+        m_hasFrame = m_reader.next(m_frame);
+    }
+
+    if (!m_hasFrame)
+    {
+        finish();
+        return;
+    }
+    if (nowUs < 0)
+        m_timer->start(0);
+    else
+        m_timer->start(int(qMax(m_frame.timeUs - nowUs, qint64(0)) / 1000 / m_speed));
+}
+
+void ReplayTransport::finish()
+{
+    m_timer->stop();
+    m_reader.close();
+    m_hasFrame = false;
+    emit disconnected();
+}
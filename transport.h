@@ -0,0 +1,122 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <QObject>
+#include <QUrl>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QtWebSockets/QWebSocket>
+#include <functional>
+#include "framecapture.h"
+
+// Carries protocol frames (UTF-8 JSON, one complete message each) between SocketWorker and a server.
+// A transport is owned by the SocketWorker and lives in its thread.
+class Transport : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Transport(QObject *parent = nullptr) : QObject(parent) {}
+
+public slots:
+    virtual void open() = 0;
+    virtual void close() = 0;
+    virtual void sendFrame(const QByteArray &frame) = 0;
+
+signals:
+    void connected();
+    void disconnected();
+    void frameReceived(const QByteArray &frame);
+};
+
+// WebSocket connection, to NeuroPlayPro by default.
+// NeuroPlayPro takes text frames only; Binary sends the same UTF-8 bytes as binary frames,
+// which saves the QString conversions with servers that accept them (e.g. the mock server).
+// Incoming frames of both kinds are accepted in either mode.
+class WebSocketTransport : public Transport
+{
+    Q_OBJECT
+public:
+    enum Mode {Text, Binary};
+
+    explicit WebSocketTransport(const QUrl &url = QUrl("ws://localhost:1336"), Mode mode = Text, QObject *parent = nullptr);
+
+    const QUrl &url() const {return m_url;}
+    Mode mode() const {return m_mode;}
+
+public slots:
+    void open() override;
+    void close() override;
+    void sendFrame(const QByteArray &frame) override;
+
+private:
+    QWebSocket *m_socket;
+    QUrl m_url;
+    Mode m_mode;
+};
+
+// Answers every frame with a function in the same process instead of a server,
+// e.g. NeuroplayMock::respond() with a session of its own. Responses are delivered
+// from the event loop in request order, like network ones; empty responses are dropped.
+class InProcessTransport : public Transport
+{
+    Q_OBJECT
+public:
+    typedef std::function<QByteArray(const QByteArray &request)> Responder;
+
+    explicit InProcessTransport(Responder responder, QObject *parent = nullptr);
+
+public slots:
+    void open() override;
+    void close() override;
+    void sendFrame(const QByteArray &frame) override;
+
+private slots:
+    void deliver();
+
+private:
+    Responder m_responder;
+    bool m_isOpen;
+    bool m_connectPending;
+    bool m_deliveryScheduled;
+    QQueue<QByteArray> m_responses;
+
+    void scheduleDelivery();
+};
+
+// Plays the incoming frames of a capture file (see FrameCaptureWriter) with their recorded timing,
+// speed times faster (0 = as fast as possible). Outgoing frames are dropped, disconnected()
+// is emitted at the end of the file.
+class ReplayTransport : public Transport
+{
+    Q_OBJECT
+public:
+    explicit ReplayTransport(const QString &fileName, double speed = 1, QObject *parent = nullptr);
+
+    const QString &fileName() const {return m_fileName;}
+    double speed() const {return m_speed;}
+
+    // Frames emitted in one go at speed 0, so the event loop keeps running
+    static const int MaxSpeedBatch = 64;
+
+public slots:
+    void open() override;
+    void close() override;
+    void sendFrame(const QByteArray &frame) override;
+
+private slots:
+    void playPending();
+
+private:
+    QString m_fileName;
+    double m_speed;
+    FrameCaptureReader m_reader;
+    QTimer *m_timer;
+    QElapsedTimer m_clock;
+    FrameCapture::Frame m_frame;
+    bool m_hasFrame;
+
+    void finish();
+};
+
+#endif // TRANSPORT_H